@@ -1,6 +1,6 @@
 /*
  * DSA Traffic Management Project
- * - adjacency-list graph, Dijkstra (min-heap)
+ * - growable graph frozen into CSR (compressed sparse row), Dijkstra (min-heap)
  * - time-dependent waiting at traffic lights
  * - exports GraphViz DOT and an interactive Leaflet map (map_india.html)
  */
@@ -10,543 +10,3973 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
 
-#define MAX 50
-#define INF 999999
+#define INF (INT_MAX / 2)     // large enough for continent-sized routes, INF + INF still fits
+#define MAX_DEPARTURE (INF / 2)   // latest departure time a query accepts
+#define INITIAL_CAPACITY 16
+#define EARTH_RADIUS_KM 6371.0088
 
 // ========== STRUCTURES ==========
+// Order in which a light shows its phases within a cycle
+typedef enum {
+    PHASES_GYR,     // green, yellow, red (the default)
+    PHASES_GRY,
+    PHASES_YGR,
+    PHASES_YRG,
+    PHASES_RGY,
+    PHASES_RYG,
+    PHASE_ORDERS
+} PhaseOrder;
+
+// A light cycles through its phases in `order`, and a cycle starts at every
+// clock time t with t % cycle == offset % cycle, so coordinated signals
+// along a corridor can be staggered. Only the green phase lets traffic on.
 typedef struct {
     int red;
     int green;
     int yellow;
+    int offset;
+    PhaseOrder order;
 } TrafficLight;
 
+// What a search reads of a junction's light, precomputed when the junction
+// is added and packed so one relaxation touches a single 12-byte entry.
+// This is the light's schedule lookup: `shift` moves the start of green
+// (wherever the offset and phase order put it) to 0, and magic is a
+// reciprocal of the cycle that turns (t + shift) % cycle into two
+// multiplies and a shift. Lights whose timings don't fit have magic 0 and
+// are timed from the TrafficLight column instead.
+typedef struct {
+    uint32_t magic;
+    uint16_t cycle;     // red + green + yellow (2 for a junction without a light)
+    uint16_t green;     // clamped to [0, cycle]; 0xFFFF without a light
+    uint16_t shift;     // (t + shift) % cycle is the time since green began
+    uint16_t unused;
+} SignalTiming;
+
 typedef struct Edge {
     int to;
     int weight;
     struct Edge *next;
 } Edge;
 
+// Pending Edge nodes are carved out of blocks that are only ever released
+// together, once the roads are merged into the CSR (or the graph is freed)
+typedef struct EdgeBlock {
+    struct EdgeBlock *next;
+    int used;
+    int capacity;
+    Edge edge[];
+} EdgeBlock;
+
 typedef struct {
-    int vertices;
-    Edge *adj[MAX];          // adjacency list
-    TrafficLight lights[MAX];
-    char names[MAX][20];
-    double lat[MAX];         // NEW: latitude
-    double lon[MAX];         // NEW: longitude
-} Graph;
+    EdgeBlock *head;     // block being filled; older (full) blocks follow
+} EdgePool;
 
-// For min-heap priority queue
+struct ContractionHierarchy;
+struct TDContractionHierarchy;
+struct LandmarkTable;
+
+// Roads are first collected in per-junction Edge lists (cheap to grow) and
+// then frozen into CSR arrays: the roads leaving u are to[offsets[u]] ..
+// to[offsets[u+1]-1], so queries walk contiguous memory.
 typedef struct {
-    int v;
-    int dist;
-} HeapNode;
+    int vertices;
+    int capacity;            // junction slots allocated
+    Edge **adj;              // pending roads, merged into the CSR by freezeGraph()
+    EdgePool pool;           // where the pending Edge nodes live
+    bool frozen;             // CSR is up to date (no pending roads)
+    int arcs;                // directed arcs in the CSR (2 per road)
+    int csr_rows;            // junctions covered by offsets[]
+    int *offsets;            // vertices + 1 entries
+    int *to;
+    int *weight;
+    // junction attributes, one column each: signal is read on every
+    // relaxation, the rest only when loading, saving, printing or by A*
+    SignalTiming *signal;    // derived from lights
+    TrafficLight *lights;
+    char (*names)[20];
+    double *lat;             // latitude
+    double *lon;             // longitude
+    double km_scale;         // verified lower bound on weight per great-circle km
+                             // (0 when coordinates can't bound the weights)
+    struct ContractionHierarchy *ch;   // built on demand, dropped when roads change
+    struct TDContractionHierarchy *tdch;
+    struct LandmarkTable *alt;
+    void *mapping;           // snapshot the CSR and junction arrays point into
+    size_t mapping_size;     // (NULL when they are heap-allocated)
+} Graph;
 
+// Indexed min-heap priority queue. Entries are stored by value in two
+// parallel arrays; pos[] maps a vertex to its slot so decreaseKey is O(log n).
+// The arrays are sized once and reused across queries.
 typedef struct {
     int size;
-    int pos[MAX];   // position of vertex in heap array for decreaseKey
-    HeapNode *arr[MAX];
+    int capacity;
+    int *vertex;    // vertex stored in each heap slot
+    int *key;       // its priority (tentative distance)
+    int *pos;       // slot of each vertex, -1 when not in the heap
 } MinHeap;
 
+// Reusable scratch space for queries; give each thread its own.
+// dist[v]/parent[v] are only valid while stamp[v] == generation, so
+// starting a new query is O(1) instead of re-initializing every vertex.
+typedef struct {
+    int capacity;
+    unsigned generation;
+    unsigned *stamp;
+    int *dist;
+    int *parent;
+    MinHeap *heap;
+    int *pot;       // A* potential of each reached vertex
+    // backward half for bidirectional searches (bdist valid while
+    // bstamp[v] == generation; bparent is the next hop towards dest)
+    unsigned *bstamp;
+    int *bdist;
+    int *bparent;
+    MinHeap *bheap;
+    int meet;       // junction where bidirectional CH searches met
+    int settled;    // vertices settled by the last query
+} QueryContext;
+
+// Point-to-point search strategies
+typedef enum {
+    ALGO_DIJKSTRA,  // plain time-dependent Dijkstra
+    ALGO_ASTAR,     // A* with a great-circle lower bound (needs km_scale > 0)
+    ALGO_BIDIR,     // forward time-dependent + backward lower-bound search
+    ALGO_CH,        // contraction hierarchy on road lengths (ignores signal waits)
+    ALGO_TDCH,      // time-dependent contraction hierarchy (honours signal waits)
+    ALGO_ALT        // A* with landmark (triangle inequality) bounds
+} RouteAlgo;
+
+// Outcome of a routeQuery
+typedef struct {
+    RouteAlgo algo;     // algorithm actually used (after fallbacks)
+    int cost;           // search cost, INF if unreachable (road length for ALGO_CH)
+    int time;           // travel time of the route with signal waits
+    int depart;         // clock time the route starts at src
+    int arrival;        // depart + time, INF if unreachable
+    int path_len;       // junctions written to the path buffer
+    int settled;        // junctions settled by the search
+} RouteResult;
+
+// Arrival at a destination for every departure time in a window, as linear
+// pieces. Leaving at t in piece k (depart[k] <= t < depart[k+1], or <= to
+// for the last) arrives at arrival[k] + slope[k] * (t - depart[k]), exact at
+// every integer t. Long pieces have slope 1 (leaving later arrives later)
+// or 0 (a red light further on absorbs the difference).
+typedef struct {
+    int from, to;       // departure window, inclusive
+    int n;              // pieces
+    int *depart;
+    int *arrival;       // INF when there is no route
+    int *slope;
+} ArrivalProfile;
+
+// How ALT landmarks are picked
+typedef enum {
+    LANDMARKS_FARTHEST,   // each new landmark is farthest from those chosen
+    LANDMARKS_AVOID       // grow landmarks where current bounds are weakest
+} LandmarkSelection;
+
+// Road distances between a few landmarks and every junction. For any
+// landmark L, |d(L,t) - d(L,v)| <= d(v,t) (roads are two-way), a lower
+// bound that waits only widen. Rows are per junction (dist[v * count + i])
+// so one bound reads one cache line.
+typedef struct LandmarkTable {
+    int count;
+    int *landmark;
+    int *dist;
+} LandmarkTable;
+
+// Contraction hierarchy over the road lengths. Junctions are contracted one
+// by one (rank = order); shortcuts keep distances between the remaining
+// ones. Only arcs towards higher ranks are kept, as a CSR, so a query is
+// two small upward searches. mid[] is the contracted junction a shortcut
+// bypasses (-1 for an original road) and is used to unpack routes.
+typedef struct ContractionHierarchy {
+    int vertices;
+    unsigned long checksum;  // graphChecksum() of the roads it was built from
+    int *rank;
+    int arcs;
+    int *offsets;
+    int *to;
+    int *weight;
+    int *mid;
+} ContractionHierarchy;
+
+// Travel time along an arc as a function of the departure time t. Signal
+// waits repeat with the light cycles, so every function is periodic in the
+// graph period (lcm of all cycles) and is stored over [0, period) as
+// breakpoints: f(t) = v[i] + slope[i] * (t - t[i]) for t[i] <= t < t[i+1].
+// Waits only ever fall at slope -1, so all slopes are integers and the
+// functions are exact at every integer time.
+typedef struct {
+    int n;          // breakpoints (t[0] is always 0)
+    int lo, hi;     // minimum / maximum travel time
+    int *t;
+    int *v;
+    int *slope;
+    int nvia;       // junctions this arc may bypass, -1 for the road itself
+    int *via;
+} TravelTimeFunction;
+
+// Time-dependent contraction hierarchy: the junction order of the static
+// hierarchy, with shortcuts carrying travel-time functions. Arcs are stored
+// once per pair at the lower-ranked junction; up[k] runs lower -> higher and
+// down[k] higher -> lower (NULL if no route in that direction). The down_*
+// arrays index the same arcs by their higher junction.
+typedef struct TDContractionHierarchy {
+    int vertices;
+    int period;
+    int *rank;
+    int arcs;
+    int *offsets;
+    int *lower;
+    int *to;
+    TravelTimeFunction **up;
+    TravelTimeFunction **down;
+    int *down_offsets;
+    int *down_arc;
+} TDContractionHierarchy;
+
 // ========== FUNCTION DECLARATIONS ==========
 void initGraph(Graph *g);
+int addJunction(Graph *g, const char *name, TrafficLight light, double lat, double lon);
 void addEdge(Graph *g, int u, int v, int w);
+void freezeGraph(Graph *g);
 void displayGraph(Graph *g);
-void loadGraphFromFile(Graph *g, const char *filename);
-void saveGraphToFile(Graph *g, const char *filename);
+bool loadGraphFromFile(Graph *g, const char *filename);
+void saveGraphToFile(Graph *g, const char *filename, bool writeDot);
+bool saveGraphSnapshot(Graph *g, const char *filename);
+bool isGraphSnapshot(const char *filename);
+bool mapGraphSnapshot(Graph *g, const char *filename);
 int getWaitingTime(TrafficLight light, int arrivalTime);
-void dijkstra(Graph *g, int src, int dest);
+bool routeQuery(Graph *g, QueryContext *qc, int src, int dest, int depart, RouteAlgo algo,
+                int *path, RouteResult *res);
+int dijkstra(Graph *g, QueryContext *qc, int src, int dest, int depart, int *path, int *path_len);
+void printRoute(Graph *g, int src, int dest, const int *path, const RouteResult *res);
+void findShortestPath(Graph *g, int src, int dest, int depart, RouteAlgo algo, const char *mapFile);
+int routeTime(Graph *g, const int *path, int path_len, int depart);
+ArrivalProfile *profileQuery(Graph *g, QueryContext *qc, int src, int dest, int from, int to);
+void freeArrivalProfile(ArrivalProfile *p);
+bool latestDeparture(Graph *g, QueryContext *qc, int src, int dest, int deadline,
+                     int *path, RouteResult *res);
+int *travelTimeMatrix(Graph *g, const int *sources, int ns, const int *targets, int nt, int depart,
+                      int threads);
+RouteAlgo prepareSearch(Graph *g, RouteAlgo algo);
+long runBatch(Graph *g, FILE *in, FILE *out, RouteAlgo algo, int threads);
+double haversineKm(double lat1, double lon1, double lat2, double lon2);
 void writeGraphViz(Graph *g, const char *filename);
 void exportLeafletMap(Graph *g, int *path, int path_len, const char *filename);
 
 // Min-heap functions
 MinHeap *createMinHeap(int capacity);
-void swapHeapNode(HeapNode **a, HeapNode **b);
+void reserveMinHeap(MinHeap *h, int capacity);
+void clearMinHeap(MinHeap *h);
 void minHeapify(MinHeap *h, int idx);
 bool isEmpty(MinHeap *h);
-HeapNode *extractMin(MinHeap *h);
+int extractMin(MinHeap *h, int *dist);
 void decreaseKey(MinHeap *h, int v, int dist);
+void insertOrDecreaseKey(MinHeap *h, int v, int dist);
+void changeKey(MinHeap *h, int v, int dist);
 bool isInMinHeap(MinHeap *h, int v);
 void freeMinHeap(MinHeap *h);
 
+// Query workspace
+QueryContext *createQueryContext(int capacity);
+void beginQuery(QueryContext *qc, int n);
+void freeQueryContext(QueryContext *qc);
+
+// Contraction hierarchies
+unsigned long graphChecksum(Graph *g);
+ContractionHierarchy *buildContractionHierarchy(Graph *g);
+bool saveContractionHierarchy(ContractionHierarchy *ch, const char *filename);
+ContractionHierarchy *loadContractionHierarchy(Graph *g, const char *filename);
+void prepareContractionHierarchy(Graph *g, const char *filename);
+void freeContractionHierarchy(ContractionHierarchy *ch);
+
+// Time-dependent contraction hierarchies
+int ttfEval(const TravelTimeFunction *f, int period, int t);
+TDContractionHierarchy *buildTDContractionHierarchy(Graph *g);
+void freeTDContractionHierarchy(TDContractionHierarchy *td);
+
+// ALT landmarks
+LandmarkTable *buildLandmarks(Graph *g, int count, LandmarkSelection sel);
+void freeLandmarks(LandmarkTable *lt);
+
 // Utility
-Edge *newEdge(int to, int weight);
+Edge *newEdge(EdgePool *pool, int to, int weight);
 void freeGraph(Graph *g);
 
 // ========== IMPLEMENTATIONS ==========
 
 void initGraph(Graph *g) {
-    g->vertices = 0;
-    for (int i = 0; i < MAX; i++) g->adj[i] = NULL, g->lat[i]=0.0, g->lon[i]=0.0;
+    memset(g, 0, sizeof(*g));
+    g->frozen = true;
+}
+
+static void unmapGraph(Graph *g);
+
+// Make room for at least `need` junctions (capacity doubles)
+static void reserveJunctions(Graph *g, int need) {
+    if (need <= g->capacity) return;
+    unmapGraph(g);
+    int cap = g->capacity ? g->capacity : INITIAL_CAPACITY;
+    while (cap < need) cap *= 2;
+    g->adj = realloc(g->adj, cap * sizeof(*g->adj));
+    g->signal = realloc(g->signal, cap * sizeof(*g->signal));
+    g->lights = realloc(g->lights, cap * sizeof(*g->lights));
+    g->names = realloc(g->names, cap * sizeof(*g->names));
+    g->lat = realloc(g->lat, cap * sizeof(*g->lat));
+    g->lon = realloc(g->lon, cap * sizeof(*g->lon));
+    if (!g->adj || !g->signal || !g->lights || !g->names || !g->lat || !g->lon) {
+        fprintf(stderr, "Out of memory growing graph to %d junctions\n", cap);
+        exit(1);
+    }
+    for (int i = g->capacity; i < cap; i++) g->adj[i] = NULL;
+    g->capacity = cap;
+}
+
+// ceil(log2 d) for d >= 2
+static inline int ceilLog2(unsigned d) {
+    return 32 - __builtin_clz(d - 1);
+}
+
+static const char phaseOrderNames[PHASE_ORDERS][4] = {
+    "GYR", "GRY", "YGR", "YRG", "RGY", "RYG",
+};
+
+static bool parsePhaseOrder(const char *name, PhaseOrder *order) {
+    for (int i = 0; i < PHASE_ORDERS; i++)
+        if (strcmp(name, phaseOrderNames[i]) == 0) { *order = (PhaseOrder)i; return true; }
+    return false;
+}
+
+// Where green begins in a light's cycle (0 <= result < cycle, cycle > 0):
+// the offset plus the phases shown before it
+static inline int lightGreenStart(TrafficLight light, int cycle) {
+    const char *phase = phaseOrderNames[(unsigned)light.order < PHASE_ORDERS ? light.order : 0];
+    long long start = light.offset;
+    for (int i = 0; phase[i] != 'G'; i++)
+        start += phase[i] == 'R' ? light.red : light.yellow;
+    start %= cycle;
+    return (int)(start < 0 ? start + cycle : start);
+}
+
+// For 2 <= d <= 2^15 and l = ceil(log2 d), magic = ceil(2^(31+l) / d) fits
+// in 32 bits and x / d == (x * magic) >> (31 + l) for every 0 <= x < 2^31 +
+// 2^16 (the rounding error of magic times x stays below 2^(31+l)), which
+// covers any time t < 2^31 plus a shift below the cycle
+static inline SignalTiming signalTiming(TrafficLight light) {
+    int cycle = light.red + light.green + light.yellow;
+    if (cycle <= 0) {
+        // never wait: t % 2 is always below green
+        return (SignalTiming){ 1u << 31, 2, 0xFFFF, 0, 0 };
+    }
+    if (cycle < 2 || cycle > 1 << 15) return (SignalTiming){ 0, 0, 0, 0, 0 };
+    int green = light.green < 0 ? 0 : light.green > cycle ? cycle : light.green;
+    int shift = (cycle - lightGreenStart(light, cycle)) % cycle;
+    uint64_t pow = 1ull << (31 + ceilLog2(cycle));
+    return (SignalTiming){ (uint32_t)((pow + cycle - 1) / cycle), (uint16_t)cycle,
+                           (uint16_t)green, (uint16_t)shift, 0 };
+}
+
+// Time since v's green began, for a vehicle arriving at 0 <= t
+static inline int signalPhaseTime(SignalTiming s, int t) {
+    uint32_t x = (uint32_t)t + s.shift;
+    uint32_t q = (uint32_t)(((uint64_t)x * s.magic) >> (31 + ceilLog2(s.cycle)));
+    return (int)(x - q * s.cycle);
+}
+
+// Wait at junction v for a vehicle arriving at time 0 <= t; equal to
+// getWaitingTime(g->lights[v], t) without a division
+static inline int junctionWait(const Graph *g, int v, int t) {
+    SignalTiming s = g->signal[v];
+    if (__builtin_expect(s.magic == 0, 0)) return getWaitingTime(g->lights[v], t);
+    int r = signalPhaseTime(s, t);
+    return r < s.green ? 0 : s.cycle - r;
 }
 
-// Create a new edge node
-Edge *newEdge(int to, int weight) {
-    Edge *e = (Edge *)malloc(sizeof(Edge));
+// Where v's light is at time t >= 0: returns the time since green began
+// and sets the green and cycle lengths. A light that never turns red has
+// green >= cycle.
+static inline int junctionPhase(const Graph *g, int v, int t, int *green, int *cycle) {
+    SignalTiming s = g->signal[v];
+    if (__builtin_expect(s.magic == 0, 0)) {
+        TrafficLight L = g->lights[v];
+        *cycle = L.red + L.green + L.yellow;
+        if (*cycle <= 0) { *green = *cycle = 1; return 0; }
+        *green = L.green < 0 ? 0 : L.green > *cycle ? *cycle : L.green;
+        int r = (t - lightGreenStart(L, *cycle)) % *cycle;
+        return r < 0 ? r + *cycle : r;
+    }
+    *green = s.green;
+    *cycle = s.cycle;
+    return signalPhaseTime(s, t);
+}
+
+// Latest arrival time at junction v that still gets past its light by time
+// t >= 0, i.e. the largest x with x + junctionWait(g, v, x) <= t: t itself
+// during green, otherwise the last green moment of t's cycle (the moment
+// before the cycle began if it has no green). Negative when that moment is
+// before time 0.
+static inline int junctionLatestArrival(const Graph *g, int v, int t) {
+    int green, cycle;
+    int r = junctionPhase(g, v, t, &green, &cycle);
+    return r < green ? t : t - r + green - 1;
+}
+
+// Append a junction; returns its index
+int addJunction(Graph *g, const char *name, TrafficLight light, double lat, double lon) {
+    reserveJunctions(g, g->vertices + 1);
+    int i = g->vertices++;
+    strncpy(g->names[i], name, sizeof(g->names[i]) - 1);
+    g->names[i][sizeof(g->names[i]) - 1] = '\0';
+    g->lights[i] = light;
+    g->signal[i] = signalTiming(light);
+    g->lat[i] = lat;
+    g->lon[i] = lon;
+    g->frozen = false;
+    return i;
+}
+
+#define EDGE_BLOCK_MIN 256
+#define EDGE_BLOCK_MAX 65536
+
+// Create a new edge node in the pool (blocks double in size up to a cap)
+Edge *newEdge(EdgePool *pool, int to, int weight) {
+    EdgeBlock *b = pool->head;
+    if (!b || b->used == b->capacity) {
+        int cap = b ? 2 * b->capacity : EDGE_BLOCK_MIN;
+        if (cap > EDGE_BLOCK_MAX) cap = EDGE_BLOCK_MAX;
+        b = malloc(sizeof(EdgeBlock) + cap * sizeof(Edge));
+        if (!b) { fprintf(stderr, "Out of memory adding roads\n"); exit(1); }
+        b->next = pool->head;
+        b->used = 0;
+        b->capacity = cap;
+        pool->head = b;
+    }
+    Edge *e = &b->edge[b->used++];
     e->to = to;
     e->weight = weight;
     e->next = NULL;
     return e;
 }
 
-// Add undirected edge
+// Release every node; with keep, the newest (largest) block stays for reuse
+static void clearEdgePool(EdgePool *pool, bool keep) {
+    EdgeBlock *b = pool->head;
+    if (keep && b) {
+        b->used = 0;
+        b = b->next;
+        pool->head->next = NULL;
+    } else {
+        pool->head = NULL;
+    }
+    while (b) {
+        EdgeBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+// Add undirected edge (pending until the next freezeGraph)
 void addEdge(Graph *g, int u, int v, int w) {
     if (u < 0 || u >= g->vertices || v < 0 || v >= g->vertices) {
-        printf("Invalid edge indices: %d - %d\n", u, v);
+        fprintf(stderr, "Invalid edge indices: %d - %d\n", u, v);
         return;
     }
-    Edge *e1 = newEdge(v, w);
+    Edge *e1 = newEdge(&g->pool, v, w);
     e1->next = g->adj[u];
     g->adj[u] = e1;
 
-    Edge *e2 = newEdge(u, w);
+    Edge *e2 = newEdge(&g->pool, u, w);
     e2->next = g->adj[v];
     g->adj[v] = e2;
+    g->frozen = false;
+}
+
+// Great-circle distance between two points in km
+double haversineKm(double lat1, double lon1, double lat2, double lon2) {
+    const double rad = M_PI / 180.0;
+    double dlat = (lat2 - lat1) * rad;
+    double dlon = (lon2 - lon1) * rad;
+    double a = sin(dlat/2) * sin(dlat/2) +
+               cos(lat1 * rad) * cos(lat2 * rad) * sin(dlon/2) * sin(dlon/2);
+    if (a > 1.0) a = 1.0;
+    return 2.0 * EARTH_RADIUS_KM * asin(sqrt(a));
+}
+
+// Find the largest factor s with weight >= s * km for every road, so that
+// s * (great-circle km to dest) never overestimates the remaining time
+// (waiting at lights only adds to it). Junctions still at the old-format
+// default 0.0,0.0 have no real position, which disables the bound.
+static void computeHeuristicScale(Graph *g) {
+    g->km_scale = 0.0;
+    for (int i = 0; i < g->vertices; i++)
+        if (g->lat[i] == 0.0 && g->lon[i] == 0.0) return;
+    double scale = INFINITY;
+    for (int u = 0; u < g->vertices; u++) {
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+            int v = g->to[k];
+            if (v < u) continue;
+            double km = haversineKm(g->lat[u], g->lon[u], g->lat[v], g->lon[v]);
+            if (km <= 0.0) continue;
+            double s = g->weight[k] / km;
+            if (s < scale) scale = s;
+        }
+    }
+    if (scale == INFINITY || scale <= 0.0) return;
+    g->km_scale = scale * (1.0 - 1e-9);   // margin for rounding in haversineKm
+}
+
+// The CSR now holds every road: refresh what is derived from it
+static void csrRebuilt(Graph *g) {
+    g->frozen = true;
+    computeHeuristicScale(g);
+    freeContractionHierarchy(g->ch);
+    g->ch = NULL;
+    freeTDContractionHierarchy(g->tdch);
+    g->tdch = NULL;
+    freeLandmarks(g->alt);
+    g->alt = NULL;
+}
+
+// Merge the pending Edge lists into the CSR arrays. Existing CSR rows are
+// kept, pending roads follow them in list order. No-op when already frozen.
+void freezeGraph(Graph *g) {
+    if (g->frozen) return;
+    unmapGraph(g);
+    int n = g->vertices;
+    int *offsets = malloc((n + 1) * sizeof(int));
+    if (!offsets) { fprintf(stderr, "Out of memory freezing graph\n"); exit(1); }
+
+    // degree = old CSR row (junctions added since the last freeze have none)
+    //          + pending roads
+    offsets[0] = 0;
+    for (int u = 0; u < n; u++) {
+        int deg = 0;
+        if (g->offsets && u < g->csr_rows) deg = g->offsets[u+1] - g->offsets[u];
+        for (Edge *p = g->adj[u]; p; p = p->next) deg++;
+        offsets[u+1] = offsets[u] + deg;
+    }
+    int arcs = offsets[n];
+    int *to = malloc((arcs ? arcs : 1) * sizeof(int));
+    int *weight = malloc((arcs ? arcs : 1) * sizeof(int));
+    if (!to || !weight) { fprintf(stderr, "Out of memory freezing graph\n"); exit(1); }
+
+    for (int u = 0; u < n; u++) {
+        int k = offsets[u];
+        if (g->offsets && u < g->csr_rows) {
+            for (int i = g->offsets[u]; i < g->offsets[u+1]; i++, k++) {
+                to[k] = g->to[i];
+                weight[k] = g->weight[i];
+            }
+        }
+        for (Edge *p = g->adj[u]; p; p = p->next, k++) {
+            to[k] = p->to;
+            weight[k] = p->weight;
+        }
+        g->adj[u] = NULL;
+    }
+    clearEdgePool(&g->pool, true);
+
+    free(g->offsets); free(g->to); free(g->weight);
+    g->offsets = offsets;
+    g->to = to;
+    g->weight = weight;
+    g->arcs = arcs;
+    g->csr_rows = n;
+    csrRebuilt(g);
 }
 
 // Print adjacency list (readable)
 void displayGraph(Graph *g) {
+    freezeGraph(g);
     printf("\nCity Map (Adjacency List):\n");
     for (int i = 0; i < g->vertices; i++) {
         printf("%d (%s) -> ", i, g->names[i]);
-        Edge *p = g->adj[i];
-        while (p) {
-            printf("[%d,%d] ", p->to, p->weight);
-            p = p->next;
-        }
+        for (int k = g->offsets[i]; k < g->offsets[i+1]; k++)
+            printf("[%d,%d] ", g->to[k], g->weight[k]);
         printf("\n");
     }
 }
 
+// ========== TEXT WRITING ==========
+// Output is formatted by hand into a buffer that lives in the writer
+// itself and is handed to stdio in large blocks.
+#define WRITE_BLOCK (1 << 16)
+
+typedef struct {
+    FILE *fp;
+    size_t len;
+    bool failed;
+    char buf[WRITE_BLOCK];
+} TextWriter;
+
+static void twFlush(TextWriter *w) {
+    if (w->len && fwrite(w->buf, 1, w->len, w->fp) != w->len) w->failed = true;
+    w->len = 0;
+}
+
+// Room for n more bytes (n <= WRITE_BLOCK)
+static inline char *twReserve(TextWriter *w, size_t n) {
+    if (w->len + n > WRITE_BLOCK) twFlush(w);
+    return w->buf + w->len;
+}
+
+static void twStr(TextWriter *w, const char *s) {
+    for (size_t n = strlen(s); n; ) {
+        size_t part = n < WRITE_BLOCK ? n : WRITE_BLOCK;
+        memcpy(twReserve(w, part), s, part);
+        w->len += part;
+        s += part;
+        n -= part;
+    }
+}
+
+static inline void twChar(TextWriter *w, char c) {
+    *twReserve(w, 1) = c;
+    w->len++;
+}
+
+static inline void twInt(TextWriter *w, int x) {
+    char *p = twReserve(w, 12);
+    unsigned u = x < 0 ? 0u - (unsigned)x : (unsigned)x;
+    char tmp[10];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + u % 10); u /= 10; } while (u);
+    if (x < 0) *p++ = '-';
+    while (n) *p++ = tmp[--n];
+    w->len = p - w->buf;
+}
+
+// Same text as printf("%.6f"). For 1/128 <= |x| < 1e9 (and 0) the rounding
+// residual computed with fma is exact, so halfway cases round like printf
+// (to even); other values go through snprintf.
+static void twFixed6(TextWriter *w, double x) {
+    if (!(fabs(x) >= 1.0 / 128 && fabs(x) < 1e9) && x != 0.0) {
+        char *p = twReserve(w, 512);
+        int n = snprintf(p, 512, "%.6f", x);
+        w->len += n < 512 ? (size_t)n : 511;
+        return;
+    }
+    double a = fabs(x);
+    double f = floor(a * 1e6);
+    double r = fma(a, 1e6, -f);     // a * 1e6 - f
+    if (r < 0) { f -= 1; r += 1; }
+    else if (r >= 1) { f += 1; r -= 1; }
+    if (r > 0.5 || (r == 0.5 && fmod(f, 2) != 0)) f += 1;
+    long long m = (long long)f;
+    if (signbit(x)) twChar(w, '-');
+    long long whole = m / 1000000;
+    int frac = (int)(m % 1000000);
+    char *p = twReserve(w, 24);
+    char tmp[20];
+    int n = 0;
+    do { tmp[n++] = (char)('0' + whole % 10); whole /= 10; } while (whole);
+    while (n) *p++ = tmp[--n];
+    *p++ = '.';
+    for (int d = 100000; d; d /= 10) *p++ = (char)('0' + frac / d % 10);
+    w->len = p - w->buf;
+}
+
+// Flush and close; false (after reporting) if anything failed
+static bool twClose(TextWriter *w, const char *what) {
+    twFlush(w);
+    if (fclose(w->fp) != 0) w->failed = true;
+    if (w->failed) fprintf(stderr, "%s: write failed\n", what);
+    return !w->failed;
+}
+
 // Save graph (edge list). Format:
 // V
-// name R G Y lat lon   (V lines)
+// name R G Y lat lon [offset ORDER]   (V lines; the light's phase offset
+//                                      and order, e.g. 30 RGY, unless 0 GYR)
 // E
 // u v w                (E lines, undirected written once with u<v)
-void saveGraphToFile(Graph *g, const char *filename) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) { perror("saveGraphToFile fopen"); return; }
-    fprintf(fp, "%d\n", g->vertices);
+// With writeDot, graphviz.dot is refreshed as well.
+void saveGraphToFile(Graph *g, const char *filename, bool writeDot) {
+    freezeGraph(g);
+    static TextWriter w;    // too big for the stack; only used from the menu thread
+    w.fp = fopen(filename, "w");
+    if (!w.fp) { perror("saveGraphToFile fopen"); return; }
+    w.len = 0;
+    w.failed = false;
+    twInt(&w, g->vertices);
+    twChar(&w, '\n');
     for (int i = 0; i < g->vertices; i++) {
-        fprintf(fp, "%s %d %d %d %.6f %.6f\n",
-                g->names[i],
-                g->lights[i].red, g->lights[i].green, g->lights[i].yellow,
-                g->lat[i], g->lon[i]);
+        twStr(&w, g->names[i]);
+        twChar(&w, ' ');
+        twInt(&w, g->lights[i].red);
+        twChar(&w, ' ');
+        twInt(&w, g->lights[i].green);
+        twChar(&w, ' ');
+        twInt(&w, g->lights[i].yellow);
+        twChar(&w, ' ');
+        twFixed6(&w, g->lat[i]);
+        twChar(&w, ' ');
+        twFixed6(&w, g->lon[i]);
+        if (g->lights[i].offset != 0 || g->lights[i].order != PHASES_GYR) {
+            twChar(&w, ' ');
+            twInt(&w, g->lights[i].offset);
+            twChar(&w, ' ');
+            twStr(&w, phaseOrderNames[g->lights[i].order]);
+        }
+        twChar(&w, '\n');
+    }
+
+    // every road is two arcs; self-loops (u == to) are not written
+    int loops = 0;
+    for (int u = 0; u < g->vertices; u++)
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++)
+            loops += g->to[k] == u;
+    twInt(&w, (g->arcs - loops) / 2);
+    twChar(&w, '\n');
+    for (int u = 0; u < g->vertices; u++)
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++)
+            if (u < g->to[k]) {
+                twInt(&w, u);
+                twChar(&w, ' ');
+                twInt(&w, g->to[k]);
+                twChar(&w, ' ');
+                twInt(&w, g->weight[k]);
+                twChar(&w, '\n');
+            }
+    if (!twClose(&w, filename)) return;
+    printf("City data saved to %s\n", filename);
+
+    if (writeDot) {
+        writeGraphViz(g, "graphviz.dot");
+        printf("GraphViz DOT exported to graphviz.dot\n");
+    }
+}
+
+// ========== BINARY SNAPSHOT ==========
+// The frozen graph as one file that is mmap'ed read-only on load, so the
+// arrays are used in place and processes share the page cache:
+//   header | offsets int[V+1] | to int[A] | weight int[A] |
+//   signal SignalTiming[V] | lights TrafficLight[V] | names char[V][20] |
+//   lat double[V] | lon double[V]
+// Every section starts on a 64-byte boundary. Values are in host byte
+// order; the header records it so a foreign file is rejected.
+#define SNAPSHOT_MAGIC "CITYGRF"      // 8 bytes with the terminator
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_ALIGN 64
+
+enum { SNAP_OFFSETS, SNAP_TO, SNAP_WEIGHT, SNAP_SIGNAL, SNAP_LIGHTS, SNAP_NAMES, SNAP_LAT,
+       SNAP_LON, SNAP_SECTIONS };
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;     // 0x01020304 as written
+    int32_t vertices;
+    int32_t arcs;
+    double km_scale;
+    uint64_t file_size;
+    uint64_t section[SNAP_SECTIONS];    // byte offset of each section
+} SnapshotHeader;
+
+// Section offsets and sizes for n junctions and `arcs` arcs; returns the
+// file size
+static size_t snapshotLayout(int n, int arcs, uint64_t *section, size_t *size) {
+    size_t sz[SNAP_SECTIONS] = {
+        (size_t)(n + 1) * sizeof(int), (size_t)arcs * sizeof(int), (size_t)arcs * sizeof(int),
+        (size_t)n * sizeof(SignalTiming), (size_t)n * sizeof(TrafficLight), (size_t)n * 20,
+        (size_t)n * sizeof(double), (size_t)n * sizeof(double),
+    };
+    size_t at = sizeof(SnapshotHeader);
+    for (int i = 0; i < SNAP_SECTIONS; i++) {
+        at = (at + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+        section[i] = at;
+        if (size) size[i] = sz[i];
+        at += sz[i];
+    }
+    return at;
+}
+
+// Does the file start like a snapshot?
+bool isGraphSnapshot(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return false;
+    char magic[8];
+    bool yes = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+               memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return yes;
+}
+
+// Written to a temporary file and renamed into place, so a graph mapped
+// from the same file stays valid while it is saved
+bool saveGraphSnapshot(Graph *g, const char *filename) {
+    freezeGraph(g);
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) { perror("saveGraphSnapshot fopen"); return false; }
+    int n = g->vertices;
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.byte_order = 0x01020304;
+    h.vertices = n;
+    h.arcs = g->arcs;
+    h.km_scale = g->km_scale;
+    size_t size[SNAP_SECTIONS];
+    h.file_size = snapshotLayout(n, g->arcs, h.section, size);
+    int zero = 0;   // offsets of an empty graph that was never frozen
+    const void *data[SNAP_SECTIONS] = {
+        g->offsets ? (const void *)g->offsets : &zero, g->to, g->weight,
+        g->signal, g->lights, g->names, g->lat, g->lon,
+    };
+
+    static const char pad[SNAPSHOT_ALIGN];
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    size_t at = sizeof(h);
+    for (int i = 0; i < SNAP_SECTIONS && ok; i++) {
+        size_t gap = h.section[i] - at;
+        ok = fwrite(pad, 1, gap, fp) == gap &&
+             (size[i] == 0 || fwrite(data[i], 1, size[i], fp) == size[i]);
+        at = h.section[i] + size[i];
+    }
+    if (fclose(fp) != 0) ok = false;
+    if (ok && rename(tmp, filename) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Failed writing snapshot %s\n", filename);
+        remove(tmp);
+    }
+    return ok;
+}
+
+// One pass over the mapped arrays: the searches trust them without checks
+static bool snapshotConsistent(const char *base, const uint64_t *section, int n, int arcs) {
+    const int *offsets = (const int *)(base + section[SNAP_OFFSETS]);
+    const int *to = (const int *)(base + section[SNAP_TO]);
+    const SignalTiming *signal = (const SignalTiming *)(base + section[SNAP_SIGNAL]);
+    const TrafficLight *lights = (const TrafficLight *)(base + section[SNAP_LIGHTS]);
+    const char (*names)[20] = (const char (*)[20])(base + section[SNAP_NAMES]);
+    if (offsets[0] != 0 || offsets[n] != arcs) return false;
+    for (int v = 0; v < n; v++) {
+        if (offsets[v+1] < offsets[v]) return false;
+        if (!memchr(names[v], '\0', sizeof(names[v]))) return false;
+        if ((unsigned)lights[v].order >= PHASE_ORDERS) return false;
+        SignalTiming s = signalTiming(lights[v]);
+        if (memcmp(&s, &signal[v], sizeof(s)) != 0) return false;
+    }
+    for (int k = 0; k < arcs; k++)
+        if (to[k] < 0 || to[k] >= n) return false;
+    return true;
+}
+
+// Point g at a snapshot written by saveGraphSnapshot. The graph stays
+// mapped until it is freed or modified (which copies it to the heap first).
+bool mapGraphSnapshot(Graph *g, const char *filename) {
+    freeGraph(g);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapshotHeader))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Cannot map snapshot %s\n", filename);
+        return false;
+    }
+    const SnapshotHeader *h = map;
+    uint64_t section[SNAP_SECTIONS];
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != SNAPSHOT_VERSION || h->byte_order != 0x01020304 ||
+        h->vertices < 0 || h->arcs < 0 || h->file_size != (uint64_t)st.st_size ||
+        snapshotLayout(h->vertices, h->arcs, section, NULL) != h->file_size ||
+        memcmp(section, h->section, sizeof(section)) != 0 ||
+        !snapshotConsistent(map, section, h->vertices, h->arcs)) {
+        fprintf(stderr, "%s is not a usable version %d snapshot\n", filename, SNAPSHOT_VERSION);
+        munmap(map, st.st_size);
+        return false;
+    }
+    char *base = map;
+    int n = h->vertices;
+    g->mapping = map;
+    g->mapping_size = st.st_size;
+    g->vertices = g->capacity = g->csr_rows = n;
+    g->arcs = h->arcs;
+    g->km_scale = h->km_scale;
+    g->offsets = (int *)(base + section[SNAP_OFFSETS]);
+    g->to = (int *)(base + section[SNAP_TO]);
+    g->weight = (int *)(base + section[SNAP_WEIGHT]);
+    g->signal = (SignalTiming *)(base + section[SNAP_SIGNAL]);
+    g->lights = (TrafficLight *)(base + section[SNAP_LIGHTS]);
+    g->names = (char (*)[20])(base + section[SNAP_NAMES]);
+    g->lat = (double *)(base + section[SNAP_LAT]);
+    g->lon = (double *)(base + section[SNAP_LON]);
+    g->adj = calloc(n ? n : 1, sizeof(*g->adj));
+    g->frozen = true;
+    return true;
+}
+
+static void *heapCopy(const void *src, size_t used, size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) { fprintf(stderr, "Out of memory copying snapshot\n"); exit(1); }
+    memcpy(p, src, used);
+    return p;
+}
+
+// Copy a mapped snapshot into heap arrays before the graph is modified
+static void unmapGraph(Graph *g) {
+    if (!g->mapping) return;
+    int n = g->vertices, cap = g->capacity;
+    g->offsets = heapCopy(g->offsets, (n + 1) * sizeof(int), (n + 1) * sizeof(int));
+    g->to = heapCopy(g->to, g->arcs * sizeof(int), g->arcs * sizeof(int));
+    g->weight = heapCopy(g->weight, g->arcs * sizeof(int), g->arcs * sizeof(int));
+    g->signal = heapCopy(g->signal, n * sizeof(*g->signal), cap * sizeof(*g->signal));
+    g->lights = heapCopy(g->lights, n * sizeof(*g->lights), cap * sizeof(*g->lights));
+    g->names = heapCopy(g->names, n * sizeof(*g->names), cap * sizeof(*g->names));
+    g->lat = heapCopy(g->lat, n * sizeof(*g->lat), cap * sizeof(*g->lat));
+    g->lon = heapCopy(g->lon, n * sizeof(*g->lon), cap * sizeof(*g->lon));
+    munmap(g->mapping, g->mapping_size);
+    g->mapping = NULL;
+    g->mapping_size = 0;
+}
+
+// ========== TEXT PARSING ==========
+// city_data.txt is read in large blocks and split into tokens by hand;
+// numbers are converted without going through the stdio scanners.
+#define TEXT_BLOCK (1 << 20)
+
+typedef struct {
+    FILE *fp;
+    char *buf;
+    size_t pos, len;
+} TextReader;
+
+static inline int trPeek(TextReader *r) {
+    if (r->pos == r->len) {
+        r->len = fread(r->buf, 1, TEXT_BLOCK, r->fp);
+        r->pos = 0;
+        if (r->len == 0) return EOF;
+    }
+    return (unsigned char)r->buf[r->pos];
+}
+
+// Skip blanks, and line breaks too when `newlines` is set
+static inline void trSkipSpace(TextReader *r, bool newlines) {
+    for (int c; (c = trPeek(r)) != EOF; r->pos++) {
+        if (c == ' ' || c == '\t' || c == '\r') continue;
+        if (c == '\n' && newlines) continue;
+        break;
+    }
+}
+
+// Next token into tok (longer tokens are cut to size-1 chars); false at the
+// end of the file, or of the line unless `newlines` is set
+static bool trToken(TextReader *r, char *tok, size_t size, bool newlines) {
+    trSkipSpace(r, newlines);
+    size_t n = 0;
+    for (int c; (c = trPeek(r)) != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n';
+         r->pos++)
+        if (n + 1 < size) tok[n++] = (char)c;
+    tok[n] = '\0';
+    return n > 0;
+}
+
+static void trSkipLine(TextReader *r) {
+    for (int c; (c = trPeek(r)) != EOF; ) {
+        r->pos++;
+        if (c == '\n') break;
+    }
+}
+
+static bool parseInt(const char *s, int *out) {
+    bool neg = *s == '-';
+    if (*s == '-' || *s == '+') s++;
+    if (!*s) return false;
+    long long x = 0;
+    for (; *s; s++) {
+        unsigned d = (unsigned)(*s - '0');
+        if (d > 9 || x > INT_MAX) return false;
+        x = x * 10 + d;
+    }
+    if (x > (long long)INT_MAX + neg) return false;
+    *out = (int)(neg ? -x : x);
+    return true;
+}
+
+// Plain decimals with at most 15 significant digits (what saveGraphToFile
+// writes) are exact as mantissa / 10^k; anything else goes to strtod
+static bool parseDouble(const char *s, double *out) {
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                    1e11, 1e12, 1e13, 1e14, 1e15 };
+    const char *p = s;
+    bool neg = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    unsigned long long m = 0;
+    int digits = 0, frac = 0;
+    bool dot = false;
+    for (; *p; p++) {
+        if (*p == '.' && !dot) { dot = true; continue; }
+        unsigned d = (unsigned)(*p - '0');
+        if (d > 9) break;
+        m = m * 10 + d;
+        frac += dot;
+        if (m) digits++;
+    }
+    if (!*p && digits <= 15 && frac <= 15 && p > s + neg + dot) {
+        double x = (double)m / pow10[frac];
+        *out = neg ? -x : x;
+        return true;
+    }
+    char *end;
+    *out = strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+// The rest of the file (what is buffered plus what is left to read) in
+// one malloc'ed block
+static char *trRemaining(TextReader *r, size_t *size) {
+    size_t have = r->len - r->pos, cap = have + TEXT_BLOCK;
+    struct stat st;
+    long at = ftell(r->fp);
+    if (fstat(fileno(r->fp), &st) == 0 && at >= 0 && st.st_size > at)
+        cap = have + (size_t)(st.st_size - at) + 1;
+    char *text = malloc(cap);
+    if (!text) { fprintf(stderr, "Out of memory reading roads\n"); exit(1); }
+    memcpy(text, r->buf + r->pos, have);
+    for (;;) {
+        if (have == cap) {
+            cap *= 2;
+            text = realloc(text, cap);
+            if (!text) { fprintf(stderr, "Out of memory reading roads\n"); exit(1); }
+        }
+        size_t got = fread(text + have, 1, cap - have, r->fp);
+        if (got == 0) break;
+        have += got;
+    }
+    r->pos = r->len = 0;
+    *size = have;
+    return text;
+}
+
+// ========== PARALLEL ROAD LOADING ==========
+// The road section ("u v w" lines) is cut into one chunk per thread at line
+// breaks and parsed in parallel. The CSR is then built by a counting sort on
+// the source junction: degrees and arc slots are claimed with atomic
+// counters, and each row is finally ordered by road index (latest first, as
+// freezeGraph would have produced from the Edge lists) so the layout does
+// not depend on the thread count.
+#define LOAD_CHUNK_BYTES (1 << 20)   // least road text worth another thread
+
+typedef struct {
+    int u, v, w;
+} RoadRecord;
+
+typedef struct {
+    int road;       // index of the road in the file
+    int to;
+    int weight;
+} ArcRecord;
+
+enum { LOAD_PARSE, LOAD_COUNT, LOAD_SCATTER, LOAD_SORT };
+
+struct RoadLoad;
+
+typedef struct {
+    struct RoadLoad *load;
+    const char *begin, *end;    // text of this chunk
+    RoadRecord *road;
+    int count, cap;
+    bool stopped;               // hit a malformed line
+    int base;                   // file index of road[0]
+    int used;                   // roads of the chunk that are loaded
+    long invalid;               // of those, with out-of-range junctions
+    int vlo, vhi;               // rows this worker orders in LOAD_SORT
+} RoadChunk;
+
+typedef struct RoadLoad {
+    Graph *g;
+    int phase;
+    atomic_int *cursor;         // row degree, then next free slot
+    ArcRecord *arc;
+} RoadLoad;
+
+// Run fn on threads elements of arg (stride bytes apart), the calling
+// thread taking the first; elements whose thread can't start run here too
+static void parallelRun(void *(*fn)(void *), void *arg, size_t stride, int threads) {
+    pthread_t *tid = malloc(threads * sizeof(pthread_t));
+    bool *started = calloc(threads, sizeof(bool));
+    for (int t = 1; t < threads; t++)
+        started[t] = pthread_create(&tid[t], NULL, fn, (char *)arg + t * stride) == 0;
+    fn(arg);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) pthread_join(tid[t], NULL);
+        else fn((char *)arg + t * stride);
+    }
+    free(started);
+    free(tid);
+}
+
+// Integer at p after blanks, followed by a blank or line end; returns the
+// position after it, or NULL
+static const char *scanInt(const char *p, const char *end, int *out) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    bool neg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    const char *digits = p;
+    long long x = 0;
+    for (unsigned d; p < end && (d = (unsigned)(*p - '0')) <= 9; p++) {
+        x = x * 10 + d;
+        if (x > (long long)INT_MAX + 1) return NULL;
+    }
+    if (p == digits || x > (long long)INT_MAX + neg) return NULL;
+    if (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') return NULL;
+    *out = (int)(neg ? -x : x);
+    return p;
+}
+
+static void parseRoads(RoadChunk *c) {
+    const char *p = c->begin, *end = c->end;
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+        if (p == end) return;
+        RoadRecord r;
+        if (!(p = scanInt(p, end, &r.u)) || !(p = scanInt(p, end, &r.v)) ||
+            !(p = scanInt(p, end, &r.w))) {
+            c->stopped = true;
+            return;
+        }
+        while (p < end && *p != '\n') p++;
+        if (c->count == c->cap) {
+            c->cap = c->cap ? 2 * c->cap : 4096;
+            c->road = realloc(c->road, c->cap * sizeof(RoadRecord));
+            if (!c->road) { fprintf(stderr, "Out of memory reading roads\n"); exit(1); }
+        }
+        c->road[c->count++] = r;
+    }
+}
+
+static int compareArcRoadDesc(const void *a, const void *b) {
+    int x = ((const ArcRecord *)a)->road, y = ((const ArcRecord *)b)->road;
+    return (x < y) - (x > y);
+}
+
+static void *roadWorker(void *arg) {
+    RoadChunk *c = arg;
+    RoadLoad *load = c->load;
+    Graph *g = load->g;
+    int n = g->vertices;
+    if (load->phase == LOAD_PARSE) {
+        parseRoads(c);
+        return NULL;
+    }
+    if (load->phase == LOAD_SORT) {
+        for (int v = c->vlo; v < c->vhi; v++) {
+            ArcRecord *row = &load->arc[g->offsets[v]];
+            int deg = g->offsets[v+1] - g->offsets[v];
+            if (deg > 32) qsort(row, deg, sizeof(ArcRecord), compareArcRoadDesc);
+            else {
+                for (int i = 1; i < deg; i++) {
+                    ArcRecord x = row[i];
+                    int j = i;
+                    for (; j > 0 && row[j-1].road < x.road; j--) row[j] = row[j-1];
+                    row[j] = x;
+                }
+            }
+            for (int i = 0; i < deg; i++) {
+                g->to[g->offsets[v] + i] = row[i].to;
+                g->weight[g->offsets[v] + i] = row[i].weight;
+            }
+        }
+        return NULL;
+    }
+    for (int i = 0; i < c->used; i++) {
+        RoadRecord r = c->road[i];
+        if (r.u < 0 || r.u >= n || r.v < 0 || r.v >= n) {
+            if (load->phase == LOAD_COUNT) c->invalid++;
+            continue;
+        }
+        if (load->phase == LOAD_COUNT) {
+            atomic_fetch_add_explicit(&load->cursor[r.u], 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&load->cursor[r.v], 1, memory_order_relaxed);
+        } else {
+            int k = atomic_fetch_add_explicit(&load->cursor[r.u], 1, memory_order_relaxed);
+            load->arc[k] = (ArcRecord){ c->base + i, r.v, r.w };
+            k = atomic_fetch_add_explicit(&load->cursor[r.v], 1, memory_order_relaxed);
+            load->arc[k] = (ArcRecord){ c->base + i, r.u, r.w };
+        }
+    }
+    return NULL;
+}
+
+// Add the first `count` roads of text (stopping at a malformed line) to a
+// graph whose junctions are all added and which has no roads yet, and
+// freeze it
+static void loadEdges(Graph *g, const char *text, size_t size, int count) {
+    int n = g->vertices;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > (int)(size / LOAD_CHUNK_BYTES) + 1) threads = (int)(size / LOAD_CHUNK_BYTES) + 1;
+    if (threads < 1) threads = 1;
+
+    RoadLoad load = { g, LOAD_PARSE, NULL, NULL };
+    RoadChunk *chunk = calloc(threads, sizeof(RoadChunk));
+    const char *at = text, *end = text + size;
+    for (int t = 0; t < threads; t++) {
+        const char *cut = t + 1 < threads ? text + size * (t + 1) / threads : end;
+        if (cut < at) cut = at;
+        while (cut > text && cut < end && cut[-1] != '\n') cut++;
+        chunk[t] = (RoadChunk){ .load = &load, .begin = at, .end = cut };
+        at = cut;
+    }
+    parallelRun(roadWorker, chunk, sizeof(RoadChunk), threads);
+
+    // keep roads up to the first malformed line and at most `count` of them
+    int total = 0;
+    bool stop = false;
+    for (int t = 0; t < threads; t++) {
+        chunk[t].base = total;
+        chunk[t].used = stop ? 0 : chunk[t].count;
+        if (chunk[t].used > count - total) chunk[t].used = count - total;
+        if (chunk[t].used < 0) chunk[t].used = 0;
+        total += chunk[t].used;
+        stop = stop || chunk[t].stopped;
+    }
+
+    load.cursor = calloc(n + 1, sizeof(atomic_int));
+    load.phase = LOAD_COUNT;
+    parallelRun(roadWorker, chunk, sizeof(RoadChunk), threads);
+    long invalid = 0;
+    for (int t = 0; t < threads; t++) invalid += chunk[t].invalid;
+    if (invalid) {
+        // reported in file order, as addEdge would have
+        for (int t = 0; t < threads; t++)
+            for (int i = 0; i < chunk[t].used; i++) {
+                RoadRecord r = chunk[t].road[i];
+                if (r.u < 0 || r.u >= n || r.v < 0 || r.v >= n)
+                    fprintf(stderr, "Invalid edge indices: %d - %d\n", r.u, r.v);
+            }
+    }
+
+    int *offsets = malloc((n + 1) * sizeof(int));
+    offsets[0] = 0;
+    for (int v = 0; v < n; v++) {
+        offsets[v+1] = offsets[v] + atomic_load_explicit(&load.cursor[v], memory_order_relaxed);
+        atomic_store_explicit(&load.cursor[v], offsets[v], memory_order_relaxed);
+    }
+    int arcs = offsets[n];
+    load.arc = malloc((arcs ? arcs : 1) * sizeof(ArcRecord));
+    int *to = malloc((arcs ? arcs : 1) * sizeof(int));
+    int *weight = malloc((arcs ? arcs : 1) * sizeof(int));
+    if (!offsets || !load.arc || !to || !weight) {
+        fprintf(stderr, "Out of memory building %d road arcs\n", arcs);
+        exit(1);
+    }
+    load.phase = LOAD_SCATTER;
+    parallelRun(roadWorker, chunk, sizeof(RoadChunk), threads);
+
+    free(g->offsets); free(g->to); free(g->weight);
+    g->offsets = offsets;
+    g->to = to;
+    g->weight = weight;
+    g->arcs = arcs;
+    g->csr_rows = n;
+    for (int t = 0; t < threads; t++) {
+        chunk[t].vlo = (int)((long long)n * t / threads);
+        chunk[t].vhi = (int)((long long)n * (t + 1) / threads);
+    }
+    load.phase = LOAD_SORT;
+    parallelRun(roadWorker, chunk, sizeof(RoadChunk), threads);
+
+    for (int t = 0; t < threads; t++) free(chunk[t].road);
+    free(chunk);
+    free(load.arc);
+    free(load.cursor);
+    csrRebuilt(g);
+}
+
+// Load graph from file. Supports new format (name R G Y lat lon, optionally
+// followed by the light's phase offset and order) and falls back to the
+// older format (name R G Y) if lat/lon are absent.
+// The graph is frozen into CSR form once all roads are read.
+// Returns false (leaving an empty graph) if the file can't be opened.
+bool loadGraphFromFile(Graph *g, const char *filename) {
+    freeGraph(g);
+    if (isGraphSnapshot(filename)) return mapGraphSnapshot(g, filename);
+    FILE *fp = fopen(filename, "r");
+    if (!fp) return false;
+    TextReader r = { fp, malloc(TEXT_BLOCK), 0, 0 };
+    if (!r.buf) { fprintf(stderr, "Out of memory reading %s\n", filename); exit(1); }
+
+    char tok[64];
+    int v;
+    if (!trToken(&r, tok, sizeof(tok), true) || !parseInt(tok, &v) || v < 0) v = -1;
+    if (v >= 0) {
+        trSkipLine(&r);
+        reserveJunctions(g, v);
+    }
+
+    // one junction per (non-blank) line
+    for (int i = 0; i < v; i++) {
+        char name[20], red[16], green[16], yellow[16], la[64], lo[64], off[16], order[8];
+        TrafficLight L = {0};
+        double lat = 0.0, lon = 0.0;
+        trSkipSpace(&r, true);
+        if (trToken(&r, name, sizeof(name), false) &&
+            trToken(&r, red, sizeof(red), false) && parseInt(red, &L.red) &&
+            trToken(&r, green, sizeof(green), false) && parseInt(green, &L.green) &&
+            trToken(&r, yellow, sizeof(yellow), false) && parseInt(yellow, &L.yellow)) {
+            // no coordinates in older files
+            if (!trToken(&r, la, sizeof(la), false) || !parseDouble(la, &lat) ||
+                !trToken(&r, lo, sizeof(lo), false) || !parseDouble(lo, &lon))
+                lat = lon = 0.0;
+            // nor phase offsets and orders
+            else if (!trToken(&r, off, sizeof(off), false) || !parseInt(off, &L.offset) ||
+                     !trToken(&r, order, sizeof(order), false) || !parsePhaseOrder(order, &L.order)) {
+                L.offset = 0;
+                L.order = PHASES_GYR;
+            }
+            addJunction(g, name, L, lat, lon);
+        } else {
+            // bad line, set defaults
+            snprintf(name, sizeof(name), "J%d", i);
+            TrafficLight def = {10, 5, 2, 0, PHASES_GYR};
+            addJunction(g, name, def, 0.0, 0.0);
+        }
+        trSkipLine(&r);
     }
 
-    // collect edges once
     int edges_count = 0;
-    for (int u = 0; u < g->vertices; u++) {
-        Edge *p = g->adj[u];
-        while (p) {
-            if (u < p->to) edges_count++;
-            p = p->next;
+    if (v < 0 || !trToken(&r, tok, sizeof(tok), true) || !parseInt(tok, &edges_count))
+        edges_count = 0;
+    trSkipLine(&r);
+    size_t size;
+    char *text = trRemaining(&r, &size);
+    free(r.buf);
+    fclose(fp);
+    loadEdges(g, text, size, edges_count);
+    free(text);
+    return true;
+}
+
+// Write GraphViz DOT file (undirected graph)
+void writeGraphViz(Graph *g, const char *filename) {
+    freezeGraph(g);
+    static TextWriter w;
+    w.fp = fopen(filename, "w");
+    if (!w.fp) { perror("writeGraphViz fopen"); return; }
+    w.len = 0;
+    w.failed = false;
+    twStr(&w, "graph City {\n");
+    twStr(&w, "  overlap=false;\n");
+    twStr(&w, "  splines=true;\n");
+    // Node labels show name and traffic timing
+    for (int i = 0; i < g->vertices; i++) {
+        twStr(&w, "  n");
+        twInt(&w, i);
+        twStr(&w, " [label=\"");
+        twStr(&w, g->names[i]);
+        twStr(&w, "\\nR:");
+        twInt(&w, g->lights[i].red);
+        twStr(&w, " G:");
+        twInt(&w, g->lights[i].green);
+        twStr(&w, " Y:");
+        twInt(&w, g->lights[i].yellow);
+        if (g->lights[i].offset != 0 || g->lights[i].order != PHASES_GYR) {
+            twStr(&w, "\\n");
+            twStr(&w, phaseOrderNames[g->lights[i].order]);
+            twStr(&w, " +");
+            twInt(&w, g->lights[i].offset);
         }
+        twStr(&w, "\"];\n");
     }
-    fprintf(fp, "%d\n", edges_count);
+    // Edges: ensure each undirected edge printed once (u<v)
     for (int u = 0; u < g->vertices; u++) {
-        Edge *p = g->adj[u];
-        while (p) {
-            if (u < p->to)
-                fprintf(fp, "%d %d %d\n", u, p->to, p->weight);
-            p = p->next;
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+            if (u < g->to[k]) {
+                twStr(&w, "  n");
+                twInt(&w, u);
+                twStr(&w, " -- n");
+                twInt(&w, g->to[k]);
+                twStr(&w, " [label=\"");
+                twInt(&w, g->weight[k]);
+                twStr(&w, "\"];\n");
+            }
+        }
+    }
+    twStr(&w, "}\n");
+    twClose(&w, filename);
+}
+
+// Compute waiting time at a traffic light given arrivalTime
+int getWaitingTime(TrafficLight light, int arrivalTime) {
+    int cycle = light.red + light.green + light.yellow;
+    if (cycle <= 0) return 0;
+    int t = (arrivalTime - lightGreenStart(light, cycle)) % cycle;   // time since green began
+    if (t < 0) t += cycle;
+    if (t < light.green) return 0;          // green window
+    return cycle - t;                        // wait till next green
+}
+
+// ========== SIGNAL WAIT KERNELS ==========
+// junctionWait() for many (junction, time) pairs at once, for high-degree
+// relaxations and the period-long samples of travel-time functions. On x86
+// the AVX2 kernel times 8 pairs per step when the CPU has it (checked once
+// at startup); otherwise the scalar loop runs. SSE alone has no per-lane
+// 64-bit shifts, which the reciprocal needs, so there is no SSE kernel.
+
+#define WAIT_BATCH 64               // most pairs timed per relaxation call
+#define WAIT_KERNEL_MIN_DEGREE 16   // fewer arcs are timed one by one
+
+typedef void (*WaitKernel)(const Graph *g, const int *v, const int *t, int *wait, int n);
+
+// wait[i] = junctionWait(g, v[i], t[i]) for 0 <= i < n
+static void junctionWaitsScalar(const Graph *g, const int *v, const int *t, int *wait, int n) {
+    for (int i = 0; i < n; i++) wait[i] = junctionWait(g, v[i], t[i]);
+}
+
+static WaitKernel junctionWaits = junctionWaitsScalar;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// junctionWaitsScalar 8 lanes at a time. The 32 x 32 -> 64-bit products
+// are taken on even and odd lanes separately, and ceilLog2(cycle) is read
+// from the float exponent of cycle - 1 (exact below 2^24).
+__attribute__((target("avx2")))
+static void junctionWaitsAvx2(const Graph *g, const int *v, const int *t, int *wait, int n) {
+    const int *signal = (const int *)g->signal;   // magic, cycle | green << 16, shift
+    const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i low32 = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i exp_bias = _mm256_set1_epi32(127 - 32);  // shift = 31 + floor(log2(cycle - 1)) + 1
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i vi = _mm256_loadu_si256((const __m256i *)(v + i));
+        __m256i idx = _mm256_add_epi32(_mm256_slli_epi32(vi, 1), vi);
+        __m256i magic = _mm256_i32gather_epi32(signal, idx, 4);
+        __m256i cg = _mm256_i32gather_epi32(signal + 1, idx, 4);
+        __m256i phase = _mm256_and_si256(_mm256_i32gather_epi32(signal + 2, idx, 4), low16);
+        __m256i time = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(t + i)), phase);
+        __m256i cycle = _mm256_and_si256(cg, low16);
+        __m256i green = _mm256_srli_epi32(cg, 16);
+        __m256i bits = _mm256_castps_si256(_mm256_cvtepi32_ps(_mm256_sub_epi32(cycle, one)));
+        __m256i shift = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), exp_bias);
+        __m256i q_even = _mm256_srlv_epi64(_mm256_mul_epu32(time, magic),
+                                           _mm256_and_si256(shift, low32));
+        __m256i q_odd = _mm256_srlv_epi64(_mm256_mul_epu32(_mm256_srli_epi64(time, 32),
+                                                           _mm256_srli_epi64(magic, 32)),
+                                          _mm256_srli_epi64(shift, 32));
+        __m256i q = _mm256_blend_epi32(q_even, _mm256_slli_epi64(q_odd, 32), 0xAA);
+        __m256i r = _mm256_sub_epi32(time, _mm256_mullo_epi32(q, cycle));
+        __m256i in_green = _mm256_cmpgt_epi32(green, r);
+        _mm256_storeu_si256((__m256i *)(wait + i),
+                            _mm256_andnot_si256(in_green, _mm256_sub_epi32(cycle, r)));
+        // lanes without a reciprocal (magic 0) take the slow path
+        int slow = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpeq_epi32(magic, _mm256_setzero_si256())));
+        while (slow) {
+            int j = i + __builtin_ctz(slow);
+            wait[j] = getWaitingTime(g->lights[v[j]], t[j]);
+            slow &= slow - 1;
+        }
+    }
+    junctionWaitsScalar(g, v + i, t + i, wait + i, n - i);
+}
+
+__attribute__((constructor))
+static void pickWaitKernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) junctionWaits = junctionWaitsAvx2;
+}
+#endif
+
+// wait[i] = junctionWait(g, v, t[i]): one junction at many times
+static void junctionWaitsAt(const Graph *g, int v, const int *t, int *wait, int n) {
+    int head[WAIT_BATCH];
+    for (int i = 0; i < WAIT_BATCH; i++) head[i] = v;
+    for (int i = 0; i < n; i += WAIT_BATCH)
+        junctionWaits(g, head, t + i, wait + i, n - i < WAIT_BATCH ? n - i : WAIT_BATCH);
+}
+
+// Time at which the heads of arcs k, k+1, ... (< end) are left, for a
+// junction left at du: arrival plus the signal wait. Returns how many arcs
+// were timed (at most WAIT_BATCH).
+static inline int arcReach(const Graph *g, int du, int k, int end, int *reach) {
+    int n = end - k < WAIT_BATCH ? end - k : WAIT_BATCH;
+    for (int i = 0; i < n; i++) reach[i] = du + g->weight[k + i];
+    if (n < WAIT_KERNEL_MIN_DEGREE) {
+        for (int i = 0; i < n; i++) reach[i] += junctionWait(g, g->to[k + i], reach[i]);
+        return n;
+    }
+    int wait[WAIT_BATCH];
+    junctionWaits(g, g->to + k, reach, wait, n);
+    for (int i = 0; i < n; i++) reach[i] += wait[i];
+    return n;
+}
+
+// ========== MIN HEAP IMPLEMENTATION ==========
+MinHeap *createMinHeap(int capacity) {
+    MinHeap *h = (MinHeap *)calloc(1, sizeof(MinHeap));
+    reserveMinHeap(h, capacity);
+    return h;
+}
+
+// Grow the heap to hold vertices 0..capacity-1 (contents are kept)
+void reserveMinHeap(MinHeap *h, int capacity) {
+    if (capacity <= h->capacity) return;
+    h->vertex = realloc(h->vertex, capacity * sizeof(int));
+    h->key = realloc(h->key, capacity * sizeof(int));
+    h->pos = realloc(h->pos, capacity * sizeof(int));
+    if (!h->vertex || !h->key || !h->pos) {
+        fprintf(stderr, "Out of memory growing heap to %d\n", capacity);
+        exit(1);
+    }
+    for (int i = h->capacity; i < capacity; i++) h->pos[i] = -1;
+    h->capacity = capacity;
+}
+
+// Empty the heap; only the slots still in use need their pos[] reset
+void clearMinHeap(MinHeap *h) {
+    for (int i = 0; i < h->size; i++) h->pos[h->vertex[i]] = -1;
+    h->size = 0;
+}
+
+static inline void heapPlace(MinHeap *h, int i, int v, int key) {
+    h->vertex[i] = v;
+    h->key[i] = key;
+    h->pos[v] = i;
+}
+
+// Sift the entry at idx down (iterative)
+void minHeapify(MinHeap *h, int idx) {
+    int v = h->vertex[idx];
+    int key = h->key[idx];
+    for (;;) {
+        int smallest = 2*idx + 1;
+        if (smallest >= h->size) break;
+        if (smallest + 1 < h->size && h->key[smallest + 1] < h->key[smallest])
+            smallest++;
+        if (h->key[smallest] >= key) break;
+        heapPlace(h, idx, h->vertex[smallest], h->key[smallest]);
+        idx = smallest;
+    }
+    heapPlace(h, idx, v, key);
+}
+
+// Sift the entry at idx up
+static void siftUp(MinHeap *h, int idx) {
+    int v = h->vertex[idx];
+    int key = h->key[idx];
+    while (idx && key < h->key[(idx-1)/2]) {
+        int parent = (idx-1)/2;
+        heapPlace(h, idx, h->vertex[parent], h->key[parent]);
+        idx = parent;
+    }
+    heapPlace(h, idx, v, key);
+}
+
+bool isEmpty(MinHeap *h) { return h->size == 0; }
+
+// extract min vertex (-1 if empty); its key is stored in *dist
+int extractMin(MinHeap *h, int *dist) {
+    if (isEmpty(h)) return -1;
+    int root = h->vertex[0];
+    *dist = h->key[0];
+    h->pos[root] = -1;
+    h->size--;
+    if (h->size > 0) {
+        heapPlace(h, 0, h->vertex[h->size], h->key[h->size]);
+        minHeapify(h, 0);
+    }
+    return root;
+}
+
+// decrease key for vertex v to new dist
+void decreaseKey(MinHeap *h, int v, int dist) {
+    int i = h->pos[v];
+    if (i == -1 || dist >= h->key[i]) return;
+    h->key[i] = dist;
+    siftUp(h, i);
+}
+
+// insert v with key dist, or lower its key if it is already queued
+void insertOrDecreaseKey(MinHeap *h, int v, int dist) {
+    if (h->pos[v] != -1) { decreaseKey(h, v, dist); return; }
+    heapPlace(h, h->size, v, dist);
+    siftUp(h, h->size++);
+}
+
+// set the key of a queued vertex v, moving it up or down as needed
+void changeKey(MinHeap *h, int v, int dist) {
+    int i = h->pos[v];
+    if (i == -1) return;
+    int old = h->key[i];
+    h->key[i] = dist;
+    if (dist < old) siftUp(h, i);
+    else minHeapify(h, i);
+}
+
+bool isInMinHeap(MinHeap *h, int v) { return h->pos[v] != -1; }
+
+void freeMinHeap(MinHeap *h) {
+    free(h->vertex);
+    free(h->key);
+    free(h->pos);
+    free(h);
+}
+
+// ========== LEAFLET MAP EXPORT ==========
+static void js_escape_name(const char *src, char *dst, size_t dstsz) {
+    // very small escaper: replace " with ' and backslash with slash
+    size_t j=0;
+    for (size_t i=0; src[i] && j+1<dstsz; i++) {
+        char c = src[i];
+        if (c=='"' || c=='\\') c = '\'';
+        dst[j++] = c;
+    }
+    dst[j] = '\0';
+}
+
+void exportLeafletMap(Graph *g, int *path, int path_len, const char *filename) {
+    freezeGraph(g);
+    FILE *fp = fopen(filename, "w");
+    if (!fp) { perror("exportLeafletMap fopen"); return; }
+
+    fprintf(fp,
+    "<!doctype html><html><head><meta charset='utf-8'>"
+    "<meta name='viewport' content='width=device-width, initial-scale=1'>"
+    "<title>City Map - India</title>"
+    "<link rel='stylesheet' href='https://unpkg.com/leaflet@1.9.4/dist/leaflet.css'/>"
+    "<style>html,body,#map{height:100%%;margin:0;} .edge-label{background:transparent;border:none;font-weight:600;}</style>"
+    "</head><body><div id='map'></div>"
+    "<script src='https://unpkg.com/leaflet@1.9.4/dist/leaflet.js'></script>"
+    "<script src='https://cdnjs.cloudflare.com/ajax/libs/leaflet.polylinedecorator/1.7.0/leaflet.polylineDecorator.min.js'></script>"
+    "<script>\n");
+
+    // Center over India
+    fprintf(fp,
+    "var map = L.map('map').setView([22.5937, 78.9629], 5);\n"
+    "L.tileLayer('https://{s}.tile.openstreetmap.org/{z}/{x}/{y}.png', {"
+    "maxZoom: 18, attribution: '&copy; OpenStreetMap contributors'}).addTo(map);\n");
+
+    // Nodes array
+    fprintf(fp, "var nodes = [\n");
+    for (int i = 0; i < g->vertices; i++) {
+        char safe[64]; js_escape_name(g->names[i], safe, sizeof(safe));
+        fprintf(fp, "  {id:%d, name:\"%s\", lat:%lf, lon:%lf}%s\n",
+                i, safe, g->lat[i], g->lon[i], (i+1<g->vertices)? ",":"");
+    }
+    fprintf(fp, "];\n");
+
+    // Edges array (u<v only)
+    fprintf(fp, "var edges = [\n");
+    int first = 1;
+    for (int u = 0; u < g->vertices; u++) {
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+            int v = g->to[k];
+            if (u < v) {
+                fprintf(fp, "  %s{u:%d, v:%d, w:%d}\n", first?"":",", u, v, g->weight[k]);
+                first = 0;
+            }
+        }
+    }
+    fprintf(fp, "];\n");
+
+    // Shortest path indices
+    fprintf(fp, "var sp = [");
+    for (int i = 0; i < path_len; i++) {
+        fprintf(fp, "%d%s", path[i], (i+1<path_len)? ",":"");
+    }
+    fprintf(fp, "];\n");
+
+    // Draw markers
+    fprintf(fp,
+    "nodes.forEach(n=>{\n"
+    "  var m = L.marker([n.lat, n.lon]).addTo(map);\n"
+    "  m.bindPopup('<b>'+n.name+'</b>');\n"
+    "});\n"
+    "function pt(id){ let n = nodes.find(x=>x.id===id); return [n.lat, n.lon]; }\n");
+
+    // Draw all edges
+    fprintf(fp,
+    "edges.forEach(e=>{\n"
+    "  var line = L.polyline([pt(e.u), pt(e.v)], {weight:3, opacity:0.6}).addTo(map);\n"
+    "  var a=pt(e.u), b=pt(e.v);\n"
+    "  var mid=[(a[0]+b[0])/2,(a[1]+b[1])/2];\n"
+    "  L.marker(mid,{opacity:0}).addTo(map)\n"
+    "    .bindTooltip(String(e.w),{permanent:true,direction:'center',className:'edge-label'});\n"
+    "});\n");
+
+    // Draw shortest path (with arrowheads)
+    fprintf(fp,
+    "if (sp.length>1){\n"
+    "  var coords=[]; for (var i=0;i<sp.length;i++){ coords.push(pt(sp[i])); }\n"
+    "  var spLine = L.polyline(coords, {color:'red', weight:6, opacity:0.9}).addTo(map);\n"
+    "  spLine.bindPopup('Shortest Path');\n"
+    "  try {\n"
+    "    var decorator = L.polylineDecorator(spLine, {patterns: [\n"
+    "      {offset: '5%%', repeat: '15%%', symbol: L.Symbol.arrowHead({pixelSize: 10, polygon: false, pathOptions: {stroke: true, color: 'red'}})}\n"
+    "    ]}).addTo(map);\n"
+    "  } catch(e) { console.warn('PolylineDecorator not available', e); }\n"
+    "  map.fitBounds(coords, {padding:[40,40]});\n"
+    "} else { // if no path, fit all nodes\n"
+    "  var all=[]; nodes.forEach(n=>all.push([n.lat,n.lon]));\n"
+    "  if (all.length>0) map.fitBounds(all, {padding:[40,40]});\n"
+    "}\n");
+
+    fprintf(fp, "</script></body></html>");
+    fclose(fp);
+    printf("Interactive India map exported to %s\n", filename);
+}
+
+// ========== QUERY WORKSPACE ==========
+QueryContext *createQueryContext(int capacity) {
+    QueryContext *qc = (QueryContext *)calloc(1, sizeof(QueryContext));
+    qc->heap = createMinHeap(capacity);
+    qc->bheap = createMinHeap(capacity);
+    beginQuery(qc, capacity);
+    return qc;
+}
+
+// Start a new query over n vertices: grows the arrays if needed, then
+// invalidates every entry by bumping the generation
+void beginQuery(QueryContext *qc, int n) {
+    if (n > qc->capacity) {
+        qc->stamp = realloc(qc->stamp, n * sizeof(unsigned));
+        qc->dist = realloc(qc->dist, n * sizeof(int));
+        qc->parent = realloc(qc->parent, n * sizeof(int));
+        qc->pot = realloc(qc->pot, n * sizeof(int));
+        qc->bstamp = realloc(qc->bstamp, n * sizeof(unsigned));
+        qc->bdist = realloc(qc->bdist, n * sizeof(int));
+        qc->bparent = realloc(qc->bparent, n * sizeof(int));
+        if (!qc->stamp || !qc->dist || !qc->parent || !qc->pot ||
+            !qc->bstamp || !qc->bdist || !qc->bparent) {
+            fprintf(stderr, "Out of memory growing query workspace to %d\n", n);
+            exit(1);
+        }
+        for (int i = qc->capacity; i < n; i++) qc->stamp[i] = qc->bstamp[i] = 0;
+        qc->capacity = n;
+    }
+    reserveMinHeap(qc->heap, n);
+    reserveMinHeap(qc->bheap, n);
+    clearMinHeap(qc->heap);
+    clearMinHeap(qc->bheap);
+    if (++qc->generation == 0) {
+        // counter wrapped: old stamps could look current again
+        memset(qc->stamp, 0, qc->capacity * sizeof(unsigned));
+        memset(qc->bstamp, 0, qc->capacity * sizeof(unsigned));
+        qc->generation = 1;
+    }
+    qc->settled = 0;
+}
+
+void freeQueryContext(QueryContext *qc) {
+    if (!qc) return;
+    free(qc->stamp);
+    free(qc->dist);
+    free(qc->parent);
+    free(qc->pot);
+    free(qc->bstamp);
+    free(qc->bdist);
+    free(qc->bparent);
+    freeMinHeap(qc->heap);
+    freeMinHeap(qc->bheap);
+    free(qc);
+}
+
+static inline int qcDist(const QueryContext *qc, int v) {
+    return qc->stamp[v] == qc->generation ? qc->dist[v] : INF;
+}
+
+static inline int qcParent(const QueryContext *qc, int v) {
+    return qc->stamp[v] == qc->generation ? qc->parent[v] : -1;
+}
+
+static inline void qcSet(QueryContext *qc, int v, int dist, int parent) {
+    qc->stamp[v] = qc->generation;
+    qc->dist[v] = dist;
+    qc->parent[v] = parent;
+}
+
+// ========== DIJKSTRA (time-dependent) ==========
+// Run a search from src, leaving at clock time depart, until dest is
+// settled. Distances are arrival clock times; they are read back with
+// qcDist()/qcParent() until the next beginQuery(). Only reached vertices
+// enter the heap, so a local query touches only the region it explores.
+static void dijkstraSearch(Graph *g, QueryContext *qc, int src, int dest, int depart) {
+    int n = g->vertices;
+    beginQuery(qc, n);
+    MinHeap *h = qc->heap;
+
+    qcSet(qc, src, depart, -1);
+    heapPlace(h, 0, src, depart);
+    h->size = 1;
+
+    while (!isEmpty(h)) {
+        int du;
+        int u = extractMin(h, &du);
+
+        if (du == INF) break;
+        qc->settled++;
+        if (u == dest) break;
+
+        for (int k = g->offsets[u], end = g->offsets[u+1]; k < end; ) {
+            int reach[WAIT_BATCH];
+            int n = arcReach(g, du, k, end, reach);
+            for (int i = 0; i < n; i++, k++) {
+                int v = g->to[k];
+                int newDist = reach[i];
+                // settled vertices can never improve (waiting keeps arrival order)
+                if (newDist < qcDist(qc, v)) {
+                    qcSet(qc, v, newDist, u);
+                    insertOrDecreaseKey(h, v, newDist);
+                }
+            }
+        }
+    }
+    clearMinHeap(h);
+}
+
+// ========== A* (great-circle / landmark lower bounds) ==========
+// Lower bound on the time from v to dest: the great-circle bound when
+// coordinates allow it and, with landmarks, the best triangle bound.
+// Each is consistent, so their maximum is too.
+static int astarPotential(Graph *g, const LandmarkTable *lt, int v, int dest) {
+    int h = 0;
+    if (g->km_scale > 0.0)
+        h = (int)(g->km_scale * haversineKm(g->lat[v], g->lon[v], g->lat[dest], g->lon[dest]));
+    if (lt) {
+        const int *dv = &lt->dist[(size_t)v * lt->count];
+        const int *dt = &lt->dist[(size_t)dest * lt->count];
+        for (int i = 0; i < lt->count; i++) {
+            if (dv[i] == INF || dt[i] == INF) continue;
+            int d = dt[i] > dv[i] ? dt[i] - dv[i] : dv[i] - dt[i];
+            if (d > h) h = d;
+        }
+    }
+    return h;
+}
+
+// Same search as dijkstraSearch, but the queue is ordered by
+// dist + astarPotential(v), so it heads towards dest. The bounds are
+// consistent, so settled vertices stay final.
+static void astarSearch(Graph *g, QueryContext *qc, int src, int dest, int depart,
+                        const LandmarkTable *lt) {
+    beginQuery(qc, g->vertices);
+    MinHeap *h = qc->heap;
+
+    qcSet(qc, src, depart, -1);
+    qc->pot[src] = astarPotential(g, lt, src, dest);
+    insertOrDecreaseKey(h, src, depart + qc->pot[src]);
+
+    while (!isEmpty(h)) {
+        int key;
+        int u = extractMin(h, &key);
+        qc->settled++;
+        if (u == dest) break;
+        int du = qc->dist[u];
+
+        for (int k = g->offsets[u], end = g->offsets[u+1]; k < end; ) {
+            int reach[WAIT_BATCH];
+            int n = arcReach(g, du, k, end, reach);
+            for (int i = 0; i < n; i++, k++) {
+                int v = g->to[k];
+                int newDist = reach[i];
+                if (qc->stamp[v] != qc->generation) {
+                    qcSet(qc, v, INF, -1);
+                    qc->pot[v] = astarPotential(g, lt, v, dest);
+                }
+                if (newDist < qc->dist[v]) {
+                    qc->dist[v] = newDist;
+                    qc->parent[v] = u;
+                    insertOrDecreaseKey(h, v, newDist + qc->pot[v]);
+                }
+            }
+        }
+    }
+    clearMinHeap(h);
+}
+
+// ========== ALT LANDMARKS ==========
+#define ALT_DEFAULT_LANDMARKS 8
+
+// Road distances from src to every junction into out[] (INF if
+// unreachable); qc->parent keeps the shortest-path tree. Returns the
+// junctions in the order they were settled, count in *settled.
+static int *roadDistances(Graph *g, QueryContext *qc, int src, int *out, int *settled) {
+    int n = g->vertices;
+    int *order = malloc((n ? n : 1) * sizeof(int));
+    *settled = 0;
+    beginQuery(qc, n);
+    qcSet(qc, src, 0, -1);
+    insertOrDecreaseKey(qc->heap, src, 0);
+    while (!isEmpty(qc->heap)) {
+        int du;
+        int u = extractMin(qc->heap, &du);
+        order[(*settled)++] = u;
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+            int v = g->to[k];
+            int nd = du + g->weight[k];
+            if (nd < qcDist(qc, v)) {
+                qcSet(qc, v, nd, u);
+                insertOrDecreaseKey(qc->heap, v, nd);
+            }
+        }
+    }
+    for (int v = 0; v < n; v++) out[v] = qcDist(qc, v);
+    return order;
+}
+
+// Current landmark bound between a and b (landmarks 0..count-1 of lt)
+static int landmarkBound(const LandmarkTable *lt, int count, int a, int b) {
+    int best = 0;
+    for (int i = 0; i < count; i++) {
+        int da = lt->dist[(size_t)a * lt->count + i], db = lt->dist[(size_t)b * lt->count + i];
+        if (da == INF || db == INF) continue;
+        int d = da > db ? da - db : db - da;
+        if (d > best) best = d;
+    }
+    return best;
+}
+
+// Avoid selection: from a root r, weigh every junction by how much the
+// bound d(r,v) is underestimated, sum weights up the shortest-path tree
+// (subtrees holding a landmark count zero), then walk down from the
+// heaviest junction along heaviest children to a leaf.
+static int avoidLandmark(Graph *g, QueryContext *qc, LandmarkTable *lt, int chosen,
+                         int root, const int *d, const int *order, int settled) {
+    int n = g->vertices;
+    long long *size = calloc(n ? n : 1, sizeof(long long));
+    bool *covered = calloc(n ? n : 1, sizeof(bool));
+    int *best_child = malloc((n ? n : 1) * sizeof(int));
+    for (int v = 0; v < n; v++) best_child[v] = -1;
+    for (int i = 0; i < chosen; i++) covered[lt->landmark[i]] = true;
+    for (int i = settled - 1; i >= 0; i--) {
+        int v = order[i];
+        if (!covered[v]) size[v] += d[v] - landmarkBound(lt, chosen, root, v);
+        int p = qcParent(qc, v);
+        if (covered[v]) size[v] = 0;
+        if (p < 0) continue;
+        if (covered[v]) covered[p] = true;
+        size[p] += size[v];
+        if (best_child[p] < 0 || size[v] > size[best_child[p]]) best_child[p] = v;
+    }
+    int w = -1;
+    for (int i = 0; i < settled; i++) {
+        int v = order[i];
+        if (!covered[v] && (w < 0 || size[v] > size[w])) w = v;
+    }
+    if (w < 0) w = order[settled - 1];
+    while (best_child[w] >= 0 && !covered[best_child[w]]) w = best_child[w];
+    free(size);
+    free(covered);
+    free(best_child);
+    return w;
+}
+
+// Pick `count` landmarks and run one road-distance search from each
+LandmarkTable *buildLandmarks(Graph *g, int count, LandmarkSelection sel) {
+    freezeGraph(g);
+    int n = g->vertices;
+    if (count > n) count = n;
+    LandmarkTable *lt = calloc(1, sizeof(LandmarkTable));
+    lt->count = count;
+    lt->landmark = malloc((count ? count : 1) * sizeof(int));
+    size_t cells = (size_t)n * count;
+    lt->dist = malloc((cells ? cells : 1) * sizeof(int));
+    if (count == 0) return lt;
+
+    QueryContext *qc = createQueryContext(n);
+    int *d = malloc(n * sizeof(int));
+    int *mind = malloc(n * sizeof(int));   // distance to the nearest landmark
+    int settled;
+    // first landmark: the junction farthest from junction 0
+    int *order = roadDistances(g, qc, 0, d, &settled);
+    int next = order[settled - 1];
+    free(order);
+    for (int v = 0; v < n; v++) mind[v] = INF;
+
+    for (int i = 0; i < count; i++) {
+        lt->landmark[i] = next;
+        order = roadDistances(g, qc, next, d, &settled);
+        free(order);
+        for (int v = 0; v < n; v++) {
+            lt->dist[(size_t)v * count + i] = d[v];
+            if (d[v] < mind[v]) mind[v] = d[v];
+        }
+        if (i + 1 == count) break;
+        if (sel == LANDMARKS_AVOID) {
+            // root at the junction the current landmarks cover worst
+            int root = 0;
+            for (int v = 0; v < n; v++) if (mind[v] != INF && mind[v] > mind[root]) root = v;
+            order = roadDistances(g, qc, root, d, &settled);
+            next = avoidLandmark(g, qc, lt, i + 1, root, d, order, settled);
+            free(order);
+        } else {
+            next = 0;
+            for (int v = 0; v < n; v++) if (mind[v] != INF && mind[v] > mind[next]) next = v;
+        }
+    }
+    free(d);
+    free(mind);
+    freeQueryContext(qc);
+    return lt;
+}
+
+void freeLandmarks(LandmarkTable *lt) {
+    if (!lt) return;
+    free(lt->landmark);
+    free(lt->dist);
+    free(lt);
+}
+
+// ========== BIDIRECTIONAL (time-dependent) ==========
+// The backward search cannot know arrival times, so it runs from dest on the
+// plain road lengths, a lower bound of the real cost (waits only add):
+//  1. forward (with waits) and backward searches alternate until a junction
+//     is settled by both; the meeting route, timed forward, gives an upper
+//     bound mu on the answer.
+//  2. let F be the forward radius at that point. Every route junction v the
+//     forward search has not settled yet has lb(v, dest) <= mu - F, so the
+//     backward search continues until its radius passes mu - F.
+//  3. the forward search finishes, only entering junctions settled by the
+//     backward search with dist + lb <= mu, and stops at dest.
+// The result is a plain forward time-dependent search, so it is exact.
+
+static inline bool fwdSettled(QueryContext *qc, int v) {
+    return qc->stamp[v] == qc->generation && qc->heap->pos[v] == -1;
+}
+
+static inline bool bwdSettled(QueryContext *qc, int v) {
+    return qc->bstamp[v] == qc->generation && qc->bheap->pos[v] == -1;
+}
+
+// Time the route src ->(forward tree) v ->(backward tree) dest with waits
+static int meetingTime(Graph *g, QueryContext *qc, int v) {
+    int t = qc->dist[v];
+    for (int u = v; u != qc->bparent[u]; ) {
+        int next = qc->bparent[u];
+        int w = INF;
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++)
+            if (g->to[k] == next && g->weight[k] < w) w = g->weight[k];
+        t += w;
+        t += junctionWait(g, next, t);
+        u = next;
+    }
+    return t;
+}
+
+// Settle one forward vertex; returns it (-1 when the queue is empty).
+// With `restricted`, only backward-settled vertices within mu are entered.
+static int forwardStep(Graph *g, QueryContext *qc, bool restricted, int mu) {
+    int du;
+    int u = extractMin(qc->heap, &du);
+    if (u < 0) return -1;
+    // left over from phase 1 but off every route that could beat mu
+    if (restricted && (!bwdSettled(qc, u) || du + qc->bdist[u] > mu)) return u;
+    qc->settled++;
+    for (int k = g->offsets[u], end = g->offsets[u+1]; k < end; ) {
+        int reach[WAIT_BATCH];
+        int n = arcReach(g, du, k, end, reach);
+        for (int i = 0; i < n; i++, k++) {
+            int v = g->to[k];
+            int newDist = reach[i];
+            if (restricted && (!bwdSettled(qc, v) || newDist + qc->bdist[v] > mu))
+                continue;
+            if (newDist < qcDist(qc, v)) {
+                qcSet(qc, v, newDist, u);
+                insertOrDecreaseKey(qc->heap, v, newDist);
+            }
+        }
+    }
+    return u;
+}
+
+// Settle one backward vertex on road lengths only
+static int backwardStep(Graph *g, QueryContext *qc) {
+    int du;
+    int u = extractMin(qc->bheap, &du);
+    if (u < 0) return -1;
+    qc->settled++;
+    for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+        int v = g->to[k];
+        int newDist = du + g->weight[k];
+        if (qc->bstamp[v] != qc->generation || newDist < qc->bdist[v]) {
+            qc->bstamp[v] = qc->generation;
+            qc->bdist[v] = newDist;
+            qc->bparent[v] = u;
+            insertOrDecreaseKey(qc->bheap, v, newDist);
+        }
+    }
+    return u;
+}
+
+static void bidirectionalPhases(Graph *g, QueryContext *qc, int src, int dest, int depart) {
+    qcSet(qc, src, depart, -1);
+    insertOrDecreaseKey(qc->heap, src, depart);
+    qc->bstamp[dest] = qc->generation;
+    qc->bdist[dest] = 0;
+    qc->bparent[dest] = dest;
+    insertOrDecreaseKey(qc->bheap, dest, 0);
+
+    // phase 1: alternate until the searches meet
+    int meet = -1;
+    bool forward = true;
+    while (meet < 0 && !(isEmpty(qc->heap) && isEmpty(qc->bheap))) {
+        if (forward && !isEmpty(qc->heap)) {
+            int u = forwardStep(g, qc, false, INF);
+            if (u == dest) return;
+            if (bwdSettled(qc, u)) meet = u;
+        } else if (!isEmpty(qc->bheap)) {
+            int u = backwardStep(g, qc);
+            if (fwdSettled(qc, u)) meet = u;
+        }
+        forward = !forward;
+    }
+    if (meet < 0 || isEmpty(qc->heap)) return;   // unreachable / already final
+
+    int mu = meetingTime(g, qc, meet);
+    int radius = qc->heap->key[0];
+
+    // phase 2: backward search covers every lb(v, dest) <= mu - radius
+    while (!isEmpty(qc->bheap) && qc->bheap->key[0] <= mu - radius)
+        backwardStep(g, qc);
+
+    // phase 3: restricted forward search
+    while (!isEmpty(qc->heap))
+        if (forwardStep(g, qc, true, mu) == dest) return;
+}
+
+static void bidirectionalSearch(Graph *g, QueryContext *qc, int src, int dest, int depart) {
+    beginQuery(qc, g->vertices);
+    bidirectionalPhases(g, qc, src, dest, depart);
+    clearMinHeap(qc->heap);
+    clearMinHeap(qc->bheap);
+}
+
+// ========== CONTRACTION HIERARCHIES ==========
+// Arc of the shrinking graph used while contracting
+typedef struct {
+    int to;
+    int weight;
+    int mid;
+} CHArc;
+
+typedef struct {
+    int size;
+    int cap;
+    CHArc *a;
+} CHArcList;
+
+// witness searches give up after this many junctions (a missed witness
+// only costs an unneeded shortcut); estimating priorities uses a smaller one
+#define CH_WITNESS_SETTLE_LIMIT 500
+#define CH_PRIORITY_SETTLE_LIMIT 50
+
+// Fingerprint of the roads; a saved hierarchy is only reused if it matches.
+// Each arc is hashed on its own and the hashes summed, so the order roads
+// come back in after a save/reload does not matter.
+unsigned long graphChecksum(Graph *g) {
+    freezeGraph(g);
+    unsigned long sum = (unsigned long)g->vertices;
+    for (int u = 0; u < g->vertices; u++) {
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+            unsigned long h = 1469598103934665603UL;     // FNV-1a
+            h = (h ^ (unsigned)u) * 1099511628211UL;
+            h = (h ^ (unsigned)g->to[k]) * 1099511628211UL;
+            h = (h ^ (unsigned)g->weight[k]) * 1099511628211UL;
+            sum += h;
+        }
+    }
+    return sum;
+}
+
+// Keep only the cheapest arc per neighbour; returns true if the list changed
+static bool chAddArc(CHArcList *l, int to, int weight, int mid) {
+    for (int i = 0; i < l->size; i++) {
+        if (l->a[i].to == to) {
+            if (weight >= l->a[i].weight) return false;
+            l->a[i].weight = weight;
+            l->a[i].mid = mid;
+            return true;
+        }
+    }
+    if (l->size == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 4;
+        l->a = realloc(l->a, l->cap * sizeof(CHArc));
+    }
+    l->a[l->size++] = (CHArc){to, weight, mid};
+    return true;
+}
+
+static void chRemoveArc(CHArcList *l, int to) {
+    for (int i = 0; i < l->size; i++)
+        if (l->a[i].to == to) { l->a[i] = l->a[--l->size]; return; }
+}
+
+// Local Dijkstra from u in the remaining graph, skipping `skip`, up to
+// distance `limit`; stops early once the `targets` junctions (neighbours of
+// skip after u) are all settled. Distances are read back with qcDist().
+static void chWitnessSearch(CHArcList *adj, QueryContext *qc, int n, int u, int skip,
+                            const CHArc *targets, int ntargets, int limit, int settle_limit) {
+    beginQuery(qc, n);
+    MinHeap *h = qc->heap;
+    qcSet(qc, u, 0, -1);
+    insertOrDecreaseKey(h, u, 0);
+    // parent[] is not needed here, so it marks the targets with -2
+    for (int i = 0; i < ntargets; i++) qcSet(qc, targets[i].to, INF, -2);
+    int settled = 0, left = ntargets;
+    while (!isEmpty(h) && settled < settle_limit && left > 0) {
+        int du;
+        int x = extractMin(h, &du);
+        if (du > limit) break;
+        settled++;
+        if (qc->parent[x] == -2) left--;
+        for (int i = 0; i < adj[x].size; i++) {
+            int y = adj[x].a[i].to;
+            if (y == skip) continue;
+            int nd = du + adj[x].a[i].weight;
+            if (nd < qcDist(qc, y)) {
+                if (qc->stamp[y] != qc->generation) qcSet(qc, y, nd, -1);
+                else qc->dist[y] = nd;      // keeps a target's mark
+                insertOrDecreaseKey(h, y, nd);
+            }
+        }
+    }
+    clearMinHeap(h);
+}
+
+// Contract v (or only count, when apply is false); returns the number of
+// shortcuts needed between its remaining neighbours
+static int chContract(CHArcList *adj, QueryContext *qc, int n, int v, bool apply) {
+    CHArcList *l = &adj[v];
+    int shortcuts = 0;
+    for (int i = 0; i + 1 < l->size; i++) {
+        int u = l->a[i].to, wu = l->a[i].weight;
+        int maxw = 0;
+        for (int j = i + 1; j < l->size; j++)
+            if (l->a[j].weight > maxw) maxw = l->a[j].weight;
+        chWitnessSearch(adj, qc, n, u, v, &l->a[i+1], l->size - i - 1, wu + maxw,
+                        apply ? CH_WITNESS_SETTLE_LIMIT : CH_PRIORITY_SETTLE_LIMIT);
+        for (int j = i + 1; j < l->size; j++) {
+            int w = l->a[j].to;
+            int via = wu + l->a[j].weight;
+            if (qcDist(qc, w) <= via) continue;   // witness route is as short
+            shortcuts++;
+            if (apply) {
+                chAddArc(&adj[u], w, via, v);
+                chAddArc(&adj[w], u, via, v);
+            }
+        }
+    }
+    return shortcuts;
+}
+
+// Edge difference (shortcuts added - arcs removed) plus contracted neighbours,
+// which spreads contraction evenly over the network
+static int chPriority(CHArcList *adj, QueryContext *qc, int n, int v, const int *deleted) {
+    return 2 * (chContract(adj, qc, n, v, false) - adj[v].size) + deleted[v];
+}
+
+ContractionHierarchy *buildContractionHierarchy(Graph *g) {
+    freezeGraph(g);
+    int n = g->vertices;
+    CHArcList *adj = calloc(n ? n : 1, sizeof(CHArcList));
+    for (int u = 0; u < n; u++)
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++)
+            if (g->to[k] != u) chAddArc(&adj[u], g->to[k], g->weight[k], -1);
+
+    QueryContext *qc = createQueryContext(n);
+    MinHeap *order = createMinHeap(n);
+    int *deleted = calloc(n ? n : 1, sizeof(int));
+    for (int v = 0; v < n; v++)
+        insertOrDecreaseKey(order, v, chPriority(adj, qc, n, v, deleted));
+
+    ContractionHierarchy *ch = calloc(1, sizeof(ContractionHierarchy));
+    ch->vertices = n;
+    ch->checksum = graphChecksum(g);
+    ch->rank = malloc((n ? n : 1) * sizeof(int));
+    ch->offsets = calloc(n + 1, sizeof(int));
+    int cap = 16;
+    int *from = malloc(cap * sizeof(int));
+    CHArc *up = malloc(cap * sizeof(CHArc));
+
+    int next = 0;
+    while (!isEmpty(order)) {
+        int key;
+        int v = extractMin(order, &key);
+        // lazy update: priorities go stale as neighbours are contracted
+        int prio = chPriority(adj, qc, n, v, deleted);
+        if (!isEmpty(order) && prio > order->key[0]) {
+            insertOrDecreaseKey(order, v, prio);
+            continue;
+        }
+        chContract(adj, qc, n, v, true);
+        ch->rank[v] = next++;
+        // every arc still at v leads to a higher rank
+        for (int i = 0; i < adj[v].size; i++) {
+            if (ch->arcs == cap) {
+                cap *= 2;
+                from = realloc(from, cap * sizeof(int));
+                up = realloc(up, cap * sizeof(CHArc));
+            }
+            from[ch->arcs] = v;
+            up[ch->arcs++] = adj[v].a[i];
+            chRemoveArc(&adj[adj[v].a[i].to], v);
+            deleted[adj[v].a[i].to]++;
+        }
+        // neighbours' priorities changed the most
+        for (int i = 0; i < adj[v].size; i++) {
+            int u = adj[v].a[i].to;
+            changeKey(order, u, chPriority(adj, qc, n, u, deleted));
+        }
+        free(adj[v].a);
+        adj[v].a = NULL;
+        adj[v].size = adj[v].cap = 0;
+    }
+
+    // upward CSR
+    for (int i = 0; i < ch->arcs; i++) ch->offsets[from[i] + 1]++;
+    for (int v = 0; v < n; v++) ch->offsets[v+1] += ch->offsets[v];
+    int *fill = malloc((n ? n : 1) * sizeof(int));
+    memcpy(fill, ch->offsets, (n ? n : 1) * sizeof(int));
+    ch->to = malloc((ch->arcs ? ch->arcs : 1) * sizeof(int));
+    ch->weight = malloc((ch->arcs ? ch->arcs : 1) * sizeof(int));
+    ch->mid = malloc((ch->arcs ? ch->arcs : 1) * sizeof(int));
+    for (int i = 0; i < ch->arcs; i++) {
+        int k = fill[from[i]]++;
+        ch->to[k] = up[i].to;
+        ch->weight[k] = up[i].weight;
+        ch->mid[k] = up[i].mid;
+    }
+
+    free(fill); free(from); free(up);
+    free(deleted);
+    free(adj);
+    freeMinHeap(order);
+    freeQueryContext(qc);
+    return ch;
+}
+
+void freeContractionHierarchy(ContractionHierarchy *ch) {
+    if (!ch) return;
+    free(ch->rank);
+    free(ch->offsets); free(ch->to); free(ch->weight); free(ch->mid);
+    free(ch);
+}
+
+// Format:
+// CH 1 vertices arcs checksum
+// rank                (vertices lines)
+// u v w mid           (arcs lines, upward arcs u -> v)
+bool saveContractionHierarchy(ContractionHierarchy *ch, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) { perror("saveContractionHierarchy fopen"); return false; }
+    fprintf(fp, "CH 1 %d %d %lu\n", ch->vertices, ch->arcs, ch->checksum);
+    for (int v = 0; v < ch->vertices; v++) fprintf(fp, "%d\n", ch->rank[v]);
+    for (int u = 0; u < ch->vertices; u++)
+        for (int k = ch->offsets[u]; k < ch->offsets[u+1]; k++)
+            fprintf(fp, "%d %d %d %d\n", u, ch->to[k], ch->weight[k], ch->mid[k]);
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) {
+        // a truncated file would only be rejected and rebuilt on every run
+        fprintf(stderr, "Failed writing contraction hierarchy %s\n", filename);
+        remove(filename);
+    }
+    return ok;
+}
+
+// Returns NULL if the file is missing, malformed or built for other roads
+ContractionHierarchy *loadContractionHierarchy(Graph *g, const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) return NULL;
+    int version, n, arcs;
+    unsigned long checksum;
+    if (fscanf(fp, "CH %d %d %d %lu", &version, &n, &arcs, &checksum) != 4 ||
+        version != 1 || n != g->vertices || arcs < 0 || checksum != graphChecksum(g)) {
+        fclose(fp);
+        return NULL;
+    }
+    ContractionHierarchy *ch = calloc(1, sizeof(ContractionHierarchy));
+    ch->vertices = n;
+    ch->checksum = checksum;
+    ch->arcs = arcs;
+    ch->rank = malloc((n ? n : 1) * sizeof(int));
+    ch->offsets = calloc(n + 1, sizeof(int));
+    ch->to = malloc((arcs ? arcs : 1) * sizeof(int));
+    ch->weight = malloc((arcs ? arcs : 1) * sizeof(int));
+    ch->mid = malloc((arcs ? arcs : 1) * sizeof(int));
+    bool ok = true;
+    // rank must be a permutation of 0..n-1
+    char *seen = calloc(n ? n : 1, 1);
+    for (int v = 0; v < n && ok; v++) {
+        int r;
+        ok = fscanf(fp, "%d", &r) == 1 && r >= 0 && r < n && !seen[r];
+        if (ok) seen[r] = 1, ch->rank[v] = r;
+    }
+    free(seen);
+    // arcs are written grouped by u in increasing order; each goes up in
+    // rank and a shortcut bypasses a lower junction, so unpacking ends
+    for (int k = 0, last = 0; k < arcs && ok; k++) {
+        int u, v, mid;
+        ok = fscanf(fp, "%d %d %d %d", &u, &v, &ch->weight[k], &mid) == 4 &&
+             u >= last && u < n && v >= 0 && v < n && ch->rank[u] < ch->rank[v] &&
+             mid >= -1 && mid < n && (mid < 0 || ch->rank[mid] < ch->rank[u]);
+        if (!ok) break;
+        ch->to[k] = v;
+        ch->mid[k] = mid;
+        ch->offsets[u+1]++;
+        last = u;
+    }
+    fclose(fp);
+    if (!ok) { freeContractionHierarchy(ch); return NULL; }
+    for (int v = 0; v < n; v++) ch->offsets[v+1] += ch->offsets[v];
+    return ch;
+}
+
+// Make g->ch available: reuse the file if it matches the roads, otherwise
+// build the hierarchy and save it there
+void prepareContractionHierarchy(Graph *g, const char *filename) {
+    freezeGraph(g);
+    if (g->ch) return;
+    g->ch = loadContractionHierarchy(g, filename);
+    if (g->ch) {
+        printf("Contraction hierarchy loaded from %s\n", filename);
+        return;
+    }
+    printf("Building contraction hierarchy for %d junctions...\n", g->vertices);
+    g->ch = buildContractionHierarchy(g);
+    printf("Added %d shortcut arcs\n", g->ch->arcs - g->arcs / 2);
+    if (saveContractionHierarchy(g->ch, filename))
+        printf("Contraction hierarchy saved to %s\n", filename);
+}
+
+// Settle one vertex of an upward search (forward or backward half)
+static void chUpwardStep(ContractionHierarchy *ch, QueryContext *qc, bool forward, int *best) {
+    MinHeap *h = forward ? qc->heap : qc->bheap;
+    int du;
+    int u = extractMin(h, &du);
+    qc->settled++;
+    // meeting point: both halves reached u
+    int other = forward ? (qc->bstamp[u] == qc->generation ? qc->bdist[u] : INF)
+                        : qcDist(qc, u);
+    if (other != INF && du + other < *best) {
+        *best = du + other;
+        qc->meet = u;
+    }
+    for (int k = ch->offsets[u]; k < ch->offsets[u+1]; k++) {
+        int v = ch->to[k];
+        int nd = du + ch->weight[k];
+        if (forward) {
+            if (nd < qcDist(qc, v)) {
+                qcSet(qc, v, nd, u);
+                insertOrDecreaseKey(h, v, nd);
+            }
+        } else if (qc->bstamp[v] != qc->generation || nd < qc->bdist[v]) {
+            qc->bstamp[v] = qc->generation;
+            qc->bdist[v] = nd;
+            qc->bparent[v] = u;
+            insertOrDecreaseKey(h, v, nd);
+        }
+    }
+}
+
+// Shortest road distance src -> dest (INF if none); qc->meet is the top
+// junction of the route, parents lead down to src and dest
+static int chSearch(ContractionHierarchy *ch, QueryContext *qc, int src, int dest) {
+    beginQuery(qc, ch->vertices);
+    qc->meet = -1;
+    qcSet(qc, src, 0, -1);
+    insertOrDecreaseKey(qc->heap, src, 0);
+    qc->bstamp[dest] = qc->generation;
+    qc->bdist[dest] = 0;
+    qc->bparent[dest] = -1;
+    insertOrDecreaseKey(qc->bheap, dest, 0);
+
+    int best = INF;
+    bool forward = true;
+    for (;;) {
+        // a half is done once its radius reaches the best meeting found
+        bool fdone = isEmpty(qc->heap) || qc->heap->key[0] >= best;
+        bool bdone = isEmpty(qc->bheap) || qc->bheap->key[0] >= best;
+        if (fdone && bdone) break;
+        if (forward ? fdone : bdone) forward = !forward;
+        chUpwardStep(ch, qc, forward, &best);
+        forward = !forward;
+    }
+    clearMinHeap(qc->heap);
+    clearMinHeap(qc->bheap);
+    return best;
+}
+
+// Append the roads behind hierarchy arc a -> b (a shortcut expands into
+// the two arcs around its middle junction). Writes b last, not a.
+static int chUnpack(ContractionHierarchy *ch, int a, int b, int *path, int len) {
+    int lo = ch->rank[a] < ch->rank[b] ? a : b;
+    int hi = lo == a ? b : a;
+    int mid = -1;
+    for (int k = ch->offsets[lo]; k < ch->offsets[lo+1]; k++)
+        if (ch->to[k] == hi) { mid = ch->mid[k]; break; }
+    if (mid < 0) {
+        path[len++] = b;
+        return len;
+    }
+    len = chUnpack(ch, a, mid, path, len);
+    return chUnpack(ch, mid, b, path, len);
+}
+
+// Full road-level route of the last chSearch, src first; returns its length
+static int chPath(ContractionHierarchy *ch, QueryContext *qc, int src, int *path) {
+    // upward chain src .. meet, collected backwards then reversed
+    int top = 0;
+    for (int v = qc->meet; v != -1; v = qc->parent[v]) path[top++] = v;
+    for (int i = 0; i < top / 2; i++) {
+        int t = path[i]; path[i] = path[top-1-i]; path[top-1-i] = t;
+    }
+    // expand each hierarchy arc in place into a scratch copy
+    int *hops = malloc(top * sizeof(int));
+    memcpy(hops, path, top * sizeof(int));
+    int len = 0;
+    path[len++] = src;
+    for (int i = 0; i + 1 < top; i++) len = chUnpack(ch, hops[i], hops[i+1], path, len);
+    free(hops);
+    for (int v = qc->meet; qc->bparent[v] != -1; v = qc->bparent[v])
+        len = chUnpack(ch, v, qc->bparent[v], path, len);
+    return len;
+}
+
+// ========== TIME-DEPENDENT CONTRACTION HIERARCHIES ==========
+// Largest light-cycle lcm a hierarchy is built for (functions hold up to
+// one breakpoint per time unit of the period)
+#define TDCH_MAX_PERIOD 86400
+// witness routes longer than this are not timed exactly
+#define TD_WITNESS_MAX_HOPS 16
+
+int ttfEval(const TravelTimeFunction *f, int period, int t) {
+    t %= period;
+    if (t < 0) t += period;
+    int lo = 0, hi = f->n - 1;
+    while (lo < hi) {               // last breakpoint <= t
+        int mid = (lo + hi + 1) / 2;
+        if (f->t[mid] <= t) lo = mid;
+        else hi = mid - 1;
+    }
+    return f->v[lo] + f->slope[lo] * (t - f->t[lo]);
+}
+
+// Compress period samples s[0..period-1] into breakpoints (no vias yet)
+static TravelTimeFunction *ttfFromSamples(const int *s, int period) {
+    int n = 0;
+    for (int i = 0; i < period; ) {
+        int slope = i + 1 < period ? s[i+1] - s[i] : 0;
+        int j = i + 1;
+        while (j < period && s[j] == s[i] + slope * (j - i)) j++;
+        n++;
+        i = j;
+    }
+    TravelTimeFunction *f = calloc(1, sizeof(TravelTimeFunction));
+    f->t = malloc(3 * n * sizeof(int));
+    f->v = f->t + n;
+    f->slope = f->v + n;
+    f->lo = INF;
+    f->hi = 0;
+    for (int i = 0; i < period; ) {
+        int slope = i + 1 < period ? s[i+1] - s[i] : 0;
+        int j = i + 1;
+        while (j < period && s[j] == s[i] + slope * (j - i)) j++;
+        f->t[f->n] = i;
+        f->v[f->n] = s[i];
+        f->slope[f->n++] = slope;
+        i = j;
+    }
+    for (int i = 0; i < period; i++) {
+        if (s[i] < f->lo) f->lo = s[i];
+        if (s[i] > f->hi) f->hi = s[i];
+    }
+    return f;
+}
+
+// Expand f back into period samples
+static void ttfSamples(const TravelTimeFunction *f, int period, int *s) {
+    for (int i = 0; i < f->n; i++) {
+        int end = i + 1 < f->n ? f->t[i+1] : period;
+        for (int t = f->t[i]; t < end; t++) s[t] = f->v[i] + f->slope[i] * (t - f->t[i]);
+    }
+}
+
+static void ttfSetVias(TravelTimeFunction *f, const int *via, int nvia) {
+    free(f->via);
+    f->nvia = nvia;
+    f->via = malloc((nvia ? nvia : 1) * sizeof(int));
+    memcpy(f->via, via, nvia * sizeof(int));
+}
+
+static void freeTtf(TravelTimeFunction *f) {
+    if (!f) return;
+    free(f->t);
+    free(f->via);
+    free(f);
+}
+
+// Drive road u -> v of length w: f(t) = w + wait at v's light
+static TravelTimeFunction *ttfRoad(Graph *g, int v, int w, int period, int *scratch) {
+    int arrival[WAIT_BATCH];
+    for (int t0 = 0; t0 < period; t0 += WAIT_BATCH) {
+        int n = period - t0 < WAIT_BATCH ? period - t0 : WAIT_BATCH;
+        for (int i = 0; i < n; i++) arrival[i] = t0 + i + w;
+        junctionWaitsAt(g, v, arrival, scratch + t0, n);
+        for (int i = 0; i < n; i++) scratch[t0 + i] += w;
+    }
+    TravelTimeFunction *f = ttfFromSamples(scratch, period);
+    int road = -1;
+    ttfSetVias(f, &road, 1);
+    return f;
+}
+
+// Follow f then h: (f then h)(t) = f(t) + h(t + f(t))
+static TravelTimeFunction *ttfLink(const TravelTimeFunction *f, const TravelTimeFunction *h,
+                                   int period, int *a, int *b) {
+    ttfSamples(f, period, a);
+    ttfSamples(h, period, b);
+    for (int t = 0; t < period; t++) a[t] += b[(t + a[t]) % period];
+    return ttfFromSamples(a, period);
+}
+
+// Pointwise minimum of f and h; keeps the vias of both. Frees f and h.
+static TravelTimeFunction *ttfMerge(TravelTimeFunction *f, TravelTimeFunction *h,
+                                    int period, int *a, int *b) {
+    ttfSamples(f, period, a);
+    ttfSamples(h, period, b);
+    for (int t = 0; t < period; t++) if (b[t] < a[t]) a[t] = b[t];
+    TravelTimeFunction *m = ttfFromSamples(a, period);
+    int *via = malloc((f->nvia + h->nvia) * sizeof(int));
+    int nvia = 0;
+    for (int i = 0; i < f->nvia + h->nvia; i++) {
+        int x = i < f->nvia ? f->via[i] : h->via[i - f->nvia];
+        bool seen = false;
+        for (int j = 0; j < nvia; j++) if (via[j] == x) seen = true;
+        if (!seen) via[nvia++] = x;
+    }
+    ttfSetVias(m, via, nvia);
+    free(via);
+    freeTtf(f);
+    freeTtf(h);
+    return m;
+}
+
+// Arc of the shrinking graph: out = this -> to, in = to -> this. The two
+// junctions' entries share the same function objects.
+typedef struct {
+    int to;
+    TravelTimeFunction *out;
+    TravelTimeFunction *in;
+} TDArc;
+
+typedef struct {
+    int size;
+    int cap;
+    TDArc *a;
+} TDArcList;
+
+typedef struct {
+    TDArcList *adj;
+    int period;
+    int *a, *b;     // period-sized scratch
+} TDBuilder;
+
+static TDArc *tdFindArc(TDArcList *l, int to) {
+    for (int i = 0; i < l->size; i++) if (l->a[i].to == to) return &l->a[i];
+    return NULL;
+}
+
+static TDArc *tdAppendArc(TDArcList *l, int to) {
+    if (l->size == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 4;
+        l->a = realloc(l->a, l->cap * sizeof(TDArc));
+    }
+    l->a[l->size] = (TDArc){to, NULL, NULL};
+    return &l->a[l->size++];
+}
+
+// Add route function f for u -> w, merging with any existing one
+static void tdAddArc(TDBuilder *b, int u, int w, TravelTimeFunction *f) {
+    TDArc *uw = tdFindArc(&b->adj[u], w);
+    if (!uw) {
+        uw = tdAppendArc(&b->adj[u], w);
+        tdAppendArc(&b->adj[w], u);
+    }
+    TDArc *wu = tdFindArc(&b->adj[w], u);
+    if (uw->out) f = ttfMerge(uw->out, f, b->period, b->a, b->b);
+    uw->out = f;
+    wu->in = f;
+}
+
+// Dijkstra from u on upper bounds (hi), skipping `skip`, up to `limit`
+static void tdWitnessSearch(TDBuilder *b, QueryContext *qc, int n, int u, int skip, int limit) {
+    beginQuery(qc, n);
+    MinHeap *h = qc->heap;
+    qcSet(qc, u, 0, -1);
+    insertOrDecreaseKey(h, u, 0);
+    int settled = 0;
+    while (!isEmpty(h) && settled < CH_WITNESS_SETTLE_LIMIT) {
+        int du;
+        int x = extractMin(h, &du);
+        if (du > limit) break;
+        settled++;
+        for (int i = 0; i < b->adj[x].size; i++) {
+            TDArc *e = &b->adj[x].a[i];
+            if (e->to == skip || !e->out) continue;
+            int nd = du + e->out->hi;
+            if (nd < qcDist(qc, e->to)) {
+                qcSet(qc, e->to, nd, x);
+                insertOrDecreaseKey(h, e->to, nd);
+            }
+        }
+    }
+    clearMinHeap(h);
+}
+
+// Does the witness route u ~> w found by tdWitnessSearch (parent chain,
+// avoiding the contracted junction) arrive no later than f at every time?
+static bool tdWitnessDominates(TDBuilder *b, QueryContext *qc, int u, int w,
+                               const TravelTimeFunction *f) {
+    int hops[TD_WITNESS_MAX_HOPS + 1];
+    int nh = 0;
+    for (int x = w; x != u; x = qc->parent[x]) {
+        if (nh == TD_WITNESS_MAX_HOPS) return false;
+        hops[nh++] = x;
+    }
+    hops[nh++] = u;
+    // a[] = travel time along the witness route, hop by hop from u
+    for (int t = 0; t < b->period; t++) b->a[t] = 0;
+    for (int i = nh - 1; i > 0; i--) {
+        TravelTimeFunction *h = tdFindArc(&b->adj[hops[i]], hops[i-1])->out;
+        ttfSamples(h, b->period, b->b);
+        for (int t = 0; t < b->period; t++) b->a[t] += b->b[(t + b->a[t]) % b->period];
+    }
+    ttfSamples(f, b->period, b->b);
+    for (int t = 0; t < b->period; t++)
+        if (b->a[t] > b->b[t]) return false;
+    return true;
+}
+
+// Add a shortcut u -> w through v for every pair of v's neighbours unless
+// a route avoiding v is never slower: either its upper bound is within the
+// shortcut's lower bound, or timing it exactly shows it never loses
+static void tdContract(TDBuilder *b, QueryContext *qc, int n, int v) {
+    TDArcList *l = &b->adj[v];
+    int maxhi = 0;
+    for (int j = 0; j < l->size; j++)
+        if (l->a[j].out && l->a[j].out->hi > maxhi) maxhi = l->a[j].out->hi;
+    for (int i = 0; i < l->size; i++) {
+        TravelTimeFunction *fin = l->a[i].in;    // u -> v
+        if (!fin) continue;
+        int u = l->a[i].to;
+        tdWitnessSearch(b, qc, n, u, v, fin->hi + maxhi);
+        for (int j = 0; j < l->size; j++) {
+            TravelTimeFunction *fout = l->a[j].out;  // v -> w
+            int w = l->a[j].to;
+            if (j == i || !fout) continue;
+            int witness = qcDist(qc, w);
+            if (witness <= fin->lo + fout->lo) continue;
+            TravelTimeFunction *f = ttfLink(fin, fout, b->period, b->a, b->b);
+            if (witness <= f->lo ||
+                (witness != INF && tdWitnessDominates(b, qc, u, w, f))) {
+                freeTtf(f);
+                continue;
+            }
+            ttfSetVias(f, &v, 1);
+            tdAddArc(b, u, w, f);
+        }
+    }
+}
+
+static int gcdInt(int a, int b) {
+    while (b) { int t = a % b; a = b; b = t; }
+    return a;
+}
+
+// lcm of all light cycles, or -1 if it exceeds TDCH_MAX_PERIOD
+static int lightPeriod(Graph *g) {
+    long long p = 1;
+    for (int i = 0; i < g->vertices; i++) {
+        int c = g->lights[i].red + g->lights[i].green + g->lights[i].yellow;
+        if (c <= 0) continue;
+        p = p / gcdInt((int)p, c) * c;
+        if (p > TDCH_MAX_PERIOD) return -1;
+    }
+    return (int)p;
+}
+
+// Returns NULL when the light cycles have no usable common period
+TDContractionHierarchy *buildTDContractionHierarchy(Graph *g) {
+    freezeGraph(g);
+    int n = g->vertices;
+    int period = lightPeriod(g);
+    if (period < 0) return NULL;
+    if (!g->ch) g->ch = buildContractionHierarchy(g);   // reuse its junction order
+
+    TDBuilder b;
+    b.period = period;
+    b.adj = calloc(n ? n : 1, sizeof(TDArcList));
+    b.a = malloc(period * sizeof(int));
+    b.b = malloc(period * sizeof(int));
+    for (int u = 0; u < n; u++)
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++)
+            if (g->to[k] != u)
+                tdAddArc(&b, u, g->to[k], ttfRoad(g, g->to[k], g->weight[k], period, b.a));
+
+    int *order = malloc((n ? n : 1) * sizeof(int));
+    for (int v = 0; v < n; v++) order[g->ch->rank[v]] = v;
+
+    TDContractionHierarchy *td = calloc(1, sizeof(TDContractionHierarchy));
+    td->vertices = n;
+    td->period = period;
+    td->rank = malloc((n ? n : 1) * sizeof(int));
+    memcpy(td->rank, g->ch->rank, n * sizeof(int));
+    td->offsets = calloc(n + 1, sizeof(int));
+    int cap = 16;
+    td->lower = malloc(cap * sizeof(int));
+    td->to = malloc(cap * sizeof(int));
+    td->up = malloc(cap * sizeof(TravelTimeFunction *));
+    td->down = malloc(cap * sizeof(TravelTimeFunction *));
+
+    QueryContext *qc = createQueryContext(n);
+    for (int r = 0; r < n; r++) {
+        int v = order[r];
+        tdContract(&b, qc, n, v);
+        // what is left at v now only leads to higher ranks; arcs are
+        // appended in rank order of their lower junction
+        for (int i = 0; i < b.adj[v].size; i++) {
+            TDArc *e = &b.adj[v].a[i];
+            if (td->arcs == cap) {
+                cap *= 2;
+                td->lower = realloc(td->lower, cap * sizeof(int));
+                td->to = realloc(td->to, cap * sizeof(int));
+                td->up = realloc(td->up, cap * sizeof(TravelTimeFunction *));
+                td->down = realloc(td->down, cap * sizeof(TravelTimeFunction *));
+            }
+            td->lower[td->arcs] = v;
+            td->to[td->arcs] = e->to;
+            td->up[td->arcs] = e->out;
+            td->down[td->arcs++] = e->in;
+            TDArcList *other = &b.adj[e->to];
+            for (int j = 0; j < other->size; j++)
+                if (other->a[j].to == v) { other->a[j] = other->a[--other->size]; break; }
+        }
+        free(b.adj[v].a);
+        b.adj[v].a = NULL;
+        b.adj[v].size = b.adj[v].cap = 0;
+    }
+    freeQueryContext(qc);
+    free(order);
+    free(b.adj);
+    free(b.a);
+    free(b.b);
+
+    // arcs were appended grouped by lower junction in rank order; sort them
+    // into CSR rows by junction id
+    int m = td->arcs;
+    size_t msz = m > 0 ? (size_t)m : 1;
+    int *perm = malloc(msz * sizeof(int));
+    for (int k = 0; k < m; k++) td->offsets[td->lower[k] + 1]++;
+    for (int v = 0; v < n; v++) td->offsets[v+1] += td->offsets[v];
+    int *fill = malloc((n + 1) * sizeof(int));
+    memcpy(fill, td->offsets, (n + 1) * sizeof(int));
+    for (int k = 0; k < m; k++) perm[fill[td->lower[k]]++] = k;
+    int *lower = malloc(msz * sizeof(int));
+    int *to = malloc(msz * sizeof(int));
+    TravelTimeFunction **up = malloc(msz * sizeof(TravelTimeFunction *));
+    TravelTimeFunction **down = malloc(msz * sizeof(TravelTimeFunction *));
+    for (int k = 0; k < m; k++) {
+        lower[k] = td->lower[perm[k]];
+        to[k] = td->to[perm[k]];
+        up[k] = td->up[perm[k]];
+        down[k] = td->down[perm[k]];
+    }
+    free(td->lower); free(td->to); free(td->up); free(td->down);
+    td->lower = lower; td->to = to; td->up = up; td->down = down;
+
+    // index by higher junction
+    td->down_offsets = calloc(n + 1, sizeof(int));
+    td->down_arc = malloc(msz * sizeof(int));
+    for (int k = 0; k < m; k++) td->down_offsets[to[k] + 1]++;
+    for (int v = 0; v < n; v++) td->down_offsets[v+1] += td->down_offsets[v];
+    memcpy(fill, td->down_offsets, (n + 1) * sizeof(int));
+    for (int k = 0; k < m; k++) td->down_arc[fill[to[k]]++] = k;
+    free(fill);
+    free(perm);
+    return td;
+}
+
+void freeTDContractionHierarchy(TDContractionHierarchy *td) {
+    if (!td) return;
+    for (int k = 0; k < td->arcs; k++) {
+        freeTtf(td->up[k]);
+        freeTtf(td->down[k]);
+    }
+    free(td->rank);
+    free(td->offsets); free(td->lower); free(td->to);
+    free(td->up); free(td->down);
+    free(td->down_offsets); free(td->down_arc);
+    free(td);
+}
+
+// Travel-time function of hierarchy arc a -> b (NULL if none)
+static TravelTimeFunction *tdArcFunction(TDContractionHierarchy *td, int a, int b) {
+    bool up = td->rank[a] < td->rank[b];
+    int lo = up ? a : b, hi = up ? b : a;
+    for (int k = td->offsets[lo]; k < td->offsets[lo+1]; k++)
+        if (td->to[k] == hi) return up ? td->up[k] : td->down[k];
+    return NULL;
+}
+
+// Exact time-dependent earliest arrival src -> dest: the arrival clock time
+// at dest leaving src at depart (INF if none). The backward search marks
+// dest's upward cone on lower bounds; the forward search evaluates the
+// functions at the actual clock time, climbing freely but only descending
+// into that cone.
+static int tdchSearch(TDContractionHierarchy *td, QueryContext *qc, int src, int dest,
+                      int depart) {
+    beginQuery(qc, td->vertices);
+    qc->bstamp[dest] = qc->generation;
+    qc->bdist[dest] = 0;
+    insertOrDecreaseKey(qc->bheap, dest, 0);
+    while (!isEmpty(qc->bheap)) {
+        int dy;
+        int y = extractMin(qc->bheap, &dy);
+        qc->settled++;
+        for (int k = td->offsets[y]; k < td->offsets[y+1]; k++) {
+            if (!td->down[k]) continue;     // need x -> y
+            int x = td->to[k];
+            int nd = dy + td->down[k]->lo;
+            if (qc->bstamp[x] != qc->generation || nd < qc->bdist[x]) {
+                qc->bstamp[x] = qc->generation;
+                qc->bdist[x] = nd;
+                insertOrDecreaseKey(qc->bheap, x, nd);
+            }
+        }
+    }
+
+    qcSet(qc, src, depart, -1);
+    insertOrDecreaseKey(qc->heap, src, depart);
+    int result = INF;
+    while (!isEmpty(qc->heap)) {
+        int du;
+        int u = extractMin(qc->heap, &du);
+        qc->settled++;
+        if (u == dest) { result = du; break; }
+        for (int k = td->offsets[u]; k < td->offsets[u+1]; k++) {
+            if (!td->up[k]) continue;
+            int v = td->to[k];
+            int nd = du + ttfEval(td->up[k], td->period, du);
+            if (nd < qcDist(qc, v)) {
+                qcSet(qc, v, nd, u);
+                insertOrDecreaseKey(qc->heap, v, nd);
+            }
+        }
+        for (int i = td->down_offsets[u]; i < td->down_offsets[u+1]; i++) {
+            int k = td->down_arc[i];
+            int y = td->lower[k];
+            if (!td->down[k] || qc->bstamp[y] != qc->generation) continue;
+            int nd = du + ttfEval(td->down[k], td->period, du);
+            if (nd < qcDist(qc, y)) {
+                qcSet(qc, y, nd, u);
+                insertOrDecreaseKey(qc->heap, y, nd);
+            }
+        }
+    }
+    clearMinHeap(qc->heap);
+    return result;
+}
+
+// Append the roads behind hierarchy arc a -> b entered at time t: pick the
+// bypassed junction (or the road itself) that realizes f(t). Writes b last.
+static int tdchUnpack(Graph *g, TDContractionHierarchy *td, int a, int b, int t,
+                      int *path, int len) {
+    TravelTimeFunction *f = tdArcFunction(td, a, b);
+    int target = ttfEval(f, td->period, t);
+    for (int i = 0; i < f->nvia; i++) {
+        int m = f->via[i];
+        if (m < 0) {
+            for (int k = g->offsets[a]; k < g->offsets[a+1]; k++) {
+                if (g->to[k] != b) continue;
+                int arrive = t + g->weight[k];
+                if (arrive + junctionWait(g, b, arrive) - t == target) {
+                    path[len++] = b;
+                    return len;
+                }
+            }
+            continue;
+        }
+        TravelTimeFunction *f1 = tdArcFunction(td, a, m);
+        TravelTimeFunction *f2 = tdArcFunction(td, m, b);
+        if (!f1 || !f2) continue;
+        int t1 = t + ttfEval(f1, td->period, t);
+        if (t1 + ttfEval(f2, td->period, t1) - t != target) continue;
+        len = tdchUnpack(g, td, a, m, t, path, len);
+        return tdchUnpack(g, td, m, b, t1, path, len);
+    }
+    path[len++] = b;    // not reached: some candidate always realizes f(t)
+    return len;
+}
+
+// Road-level route of the last tdchSearch, src first
+static int tdchPath(Graph *g, TDContractionHierarchy *td, QueryContext *qc, int src, int dest,
+                    int *path) {
+    int top = 0;
+    for (int v = dest; v != -1; v = qc->parent[v]) path[top++] = v;
+    int *hops = malloc(top * sizeof(int));
+    for (int i = 0; i < top; i++) hops[i] = path[top-1-i];
+    int len = 0;
+    path[len++] = src;
+    for (int i = 0; i + 1 < top; i++)
+        len = tdchUnpack(g, td, hops[i], hops[i+1], qc->dist[hops[i]], path, len);
+    free(hops);
+    return len;
+}
+
+// Time taken to drive path[0..path_len-1] leaving at clock time depart,
+// waiting at every light on arrival
+int routeTime(Graph *g, const int *path, int path_len, int depart) {
+    int t = depart;
+    for (int i = 0; i + 1 < path_len; i++) {
+        int u = path[i], v = path[i+1], w = INF;
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++)
+            if (g->to[k] == v && g->weight[k] < w) w = g->weight[k];
+        if (w == INF) return INF;
+        t += w;
+        t += junctionWait(g, v, t);
+    }
+    return t - depart;
+}
+
+// Build what the algorithm needs on the (frozen) graph and return the one
+// that will actually run: Dijkstra when A* has no usable bound or the light
+// cycles have no common period for a time-dependent hierarchy. Once it has
+// run, searches with the returned algorithm only read the graph.
+RouteAlgo prepareSearch(Graph *g, RouteAlgo algo) {
+    if (algo == ALGO_ASTAR && g->km_scale <= 0.0) algo = ALGO_DIJKSTRA;
+    if (algo == ALGO_TDCH && !g->tdch && !(g->tdch = buildTDContractionHierarchy(g)))
+        algo = ALGO_DIJKSTRA;
+    if (algo == ALGO_CH && !g->ch) g->ch = buildContractionHierarchy(g);
+    if (algo == ALGO_ALT && !g->alt)
+        g->alt = buildLandmarks(g, ALT_DEFAULT_LANDMARKS, LANDMARKS_AVOID);
+    return algo;
+}
+
+// Run the chosen search and return the route cost (INF if unreachable).
+// Time-dependent searches leave src at depart and cost the travel time.
+static RouteAlgo runSearch(Graph *g, QueryContext *qc, int src, int dest, int depart,
+                           RouteAlgo algo, int *cost) {
+    algo = prepareSearch(g, algo);
+    if (algo == ALGO_CH) {
+        *cost = chSearch(g->ch, qc, src, dest);    // lengths don't depend on the clock
+        return algo;
+    }
+    int arrival;
+    if (algo == ALGO_TDCH) arrival = tdchSearch(g->tdch, qc, src, dest, depart);
+    else {
+        if (algo == ALGO_ALT) astarSearch(g, qc, src, dest, depart, g->alt);
+        else if (algo == ALGO_ASTAR) astarSearch(g, qc, src, dest, depart, NULL);
+        else if (algo == ALGO_BIDIR) bidirectionalSearch(g, qc, src, dest, depart);
+        else dijkstraSearch(g, qc, src, dest, depart);
+        arrival = qcDist(qc, dest);
+    }
+    *cost = arrival == INF ? INF : arrival - depart;
+    return algo;
+}
+
+// Route of the last runSearch in travel order; returns its length
+static int searchPath(Graph *g, QueryContext *qc, RouteAlgo algo, int src, int dest, int *path) {
+    if (algo == ALGO_CH) return chPath(g->ch, qc, src, path);
+    if (algo == ALGO_TDCH) return tdchPath(g, g->tdch, qc, src, dest, path);
+    int len = 0;
+    for (int v = dest; v != -1; v = qcParent(qc, v))
+        path[len++] = v;
+    for (int i = 0; i < len / 2; i++) {
+        int t = path[i]; path[i] = path[len-1-i]; path[len-1-i] = t;
+    }
+    return len;
+}
+
+// Route src -> dest leaving at clock time depart (0 <= depart <=
+// MAX_DEPARTURE), without printing or writing files. Lights are timed on
+// that clock, so the result is the earliest arrival for that departure.
+// path (room for g->vertices junctions, or NULL) receives the route in
+// travel order. Returns false on invalid indices or departure time.
+// Hierarchies and landmarks the algorithm needs are built on first use.
+bool routeQuery(Graph *g, QueryContext *qc, int src, int dest, int depart, RouteAlgo algo,
+                int *path, RouteResult *res) {
+    int n = g->vertices;
+    if (src < 0 || src >= n || dest < 0 || dest >= n) return false;
+    if (depart < 0 || depart > MAX_DEPARTURE) return false;
+    freezeGraph(g);
+    res->algo = runSearch(g, qc, src, dest, depart, algo, &res->cost);
+    res->settled = qc->settled;
+    res->path_len = 0;
+    res->time = res->cost;
+    res->depart = depart;
+    res->arrival = INF;
+    if (res->cost == INF) return true;
+    if (path) res->path_len = searchPath(g, qc, res->algo, src, dest, path);
+    if (res->algo == ALGO_CH) {
+        // the hierarchy only knows road lengths; time the route with waits
+        if (path) res->time = routeTime(g, path, res->path_len, depart);
+        else {
+            int *tmp = malloc(n * sizeof(int));
+            res->time = routeTime(g, tmp, searchPath(g, qc, res->algo, src, dest, tmp), depart);
+            free(tmp);
+        }
+    }
+    res->arrival = depart + res->time;
+    return true;
+}
+
+// Plain time-dependent Dijkstra leaving src at clock time depart; returns
+// the earliest arrival time at dest (INF if there is no route)
+int dijkstra(Graph *g, QueryContext *qc, int src, int dest, int depart, int *path, int *path_len) {
+    RouteResult res;
+    if (!routeQuery(g, qc, src, dest, depart, ALGO_DIJKSTRA, path, &res)) return INF;
+    if (path_len) *path_len = res.path_len;
+    return res.arrival;
+}
+
+// Print a routeQuery result
+void printRoute(Graph *g, int src, int dest, const int *path, const RouteResult *res) {
+    if (res->cost == INF) {
+        printf("\nNo path found from %s to %s\n", g->names[src], g->names[dest]);
+        return;
+    }
+    printf("\nShortest Time from %s to %s = %d units\n",
+           g->names[src], g->names[dest], res->cost);
+    if (res->depart != 0)
+        printf("Departing at %d, arriving at %d\n", res->depart, res->arrival);
+    if (res->algo == ALGO_CH)
+        printf("(road lengths only; signal waits are not included)\n");
+    printf("\nPath Travel Summary:\n");
+    for (int i = 0; i < res->path_len; i++) {
+        printf("%s", g->names[path[i]]);
+        if (i + 1 < res->path_len) printf(" -> ");
+    }
+    if (res->algo == ALGO_CH)
+        printf("\nTotal Time Taken (with signal waits on this route): %d units\n", res->time);
+    else
+        printf("\nTotal Time Taken: %d units\n", res->time);
+    printf("Junctions settled by the search: %d\n", res->settled);
+}
+
+// Route src -> dest leaving at depart with the given algorithm and print
+// it; with mapFile, also export the map with the route highlighted
+void findShortestPath(Graph *g, int src, int dest, int depart, RouteAlgo algo,
+                      const char *mapFile) {
+    // the interactive menu is single-threaded, so one workspace is reused
+    static QueryContext *qc = NULL;
+    if (!qc) qc = createQueryContext(g->vertices);
+    int *path = malloc((g->vertices ? g->vertices : 1) * sizeof(int));
+    RouteResult res;
+    if (!routeQuery(g, qc, src, dest, depart, algo, path, &res)) {
+        printf("Invalid source/destination indices or departure time.\n");
+        free(path);
+        return;
+    }
+    if (res.algo != algo && algo == ALGO_ASTAR)
+        printf("A* needs coordinates for every junction; using Dijkstra.\n");
+    else if (res.algo != algo)
+        printf("Light cycles have no common period up to %d; using Dijkstra.\n",
+               TDCH_MAX_PERIOD);
+    printRoute(g, src, dest, path, &res);
+    if (mapFile) exportLeafletMap(g, path, res.path_len, mapFile);
+    free(path);
+}
+
+// ========== PROFILE QUERIES ==========
+// Arrival at dest for every departure in [from, to], from one
+// label-correcting search instead of one search per departure. A label is
+// the arrival at a junction as a function of the departure offset
+// (t - from), kept as breakpoints in a TravelTimeFunction whose values are
+// arrival clock times. Waits keep arrivals in departure order, so labels
+// never decrease: a label's minimum is its value at offset 0, which keys
+// the queue, and nothing popped after dest's latest arrival can help.
+// Labels are linked and merged piece by piece, so a relaxation costs the
+// breakpoints and light cycles it crosses, not the window length.
+#define PROFILE_MAX_WINDOW 86400    // departure times in one profile
+
+// Breakpoints of a label under construction. Samples arrive in runs and are
+// compressed as ttfFromSamples would: a piece's first two samples fix its
+// slope and it extends while the samples stay on that line.
+typedef struct {
+    int n, cap;
+    int end;            // samples so far
+    int *t, *v, *slope;
+} ProfileBuilder;
+
+static void profilePush(ProfileBuilder *b, int v) {
+    if (b->n == b->cap) {
+        b->cap = b->cap ? 2 * b->cap : 64;
+        b->t = realloc(b->t, b->cap * sizeof(int));
+        b->v = realloc(b->v, b->cap * sizeof(int));
+        b->slope = realloc(b->slope, b->cap * sizeof(int));
+        if (!b->t || !b->v || !b->slope) {
+            fprintf(stderr, "Out of memory building a profile\n");
+            exit(1);
         }
     }
-    fclose(fp);
-    printf("City data saved to %s\n", filename);
-
-    // also write DOT
-    writeGraphViz(g, "graphviz.dot");
-    printf("GraphViz DOT exported to graphviz.dot\n");
+    b->t[b->n] = b->end;
+    b->v[b->n] = v;
+    b->slope[b->n++] = 0;
 }
 
-// Load graph from file. Supports new format (name R G Y lat lon) and
-// falls back to the older format (name R G Y) if lat/lon are absent.
-void loadGraphFromFile(Graph *g, const char *filename) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        printf("File not found! Starting fresh.\n");
-        initGraph(g);
-        return;
+// Append the samples v, v + s, ..., v + s * (len - 1)
+static void profileRun(ProfileBuilder *b, int v, int s, int len) {
+    while (len > 0) {
+        int k = b->n - 1;
+        if (k >= 0 && b->end - b->t[k] == 1) b->slope[k] = v - b->v[k];
+        if (k < 0 || v != b->v[k] + b->slope[k] * (b->end - b->t[k])) profilePush(b, v), k++;
+        b->end++;
+        v += s;
+        len--;
+        if (len > 0 && (b->end - b->t[k] == 1 || b->slope[k] == s)) {
+            b->slope[k] = s;
+            b->end += len;
+            return;
+        }
     }
+}
 
-    initGraph(g);
-    int v;
-    if (fscanf(fp, "%d", &v) != 1) { fclose(fp); initGraph(g); return; }
-    g->vertices = v;
+// The built label; b is emptied for the next one
+static TravelTimeFunction *profileFinish(ProfileBuilder *b) {
+    int n = b->n;
+    TravelTimeFunction *f = calloc(1, sizeof(TravelTimeFunction));
+    f->n = n;
+    f->t = malloc(3 * n * sizeof(int));
+    f->v = f->t + n;
+    f->slope = f->v + n;
+    memcpy(f->t, b->t, n * sizeof(int));
+    memcpy(f->v, b->v, n * sizeof(int));
+    memcpy(f->slope, b->slope, n * sizeof(int));
+    f->lo = f->v[0];
+    f->hi = f->v[n-1] + f->slope[n-1] * (b->end - 1 - f->t[n-1]);
+    b->n = b->end = 0;
+    return f;
+}
 
-    // consume newline (file pointer is at start of junction lines)
-    for (int i = 0; i < g->vertices; i++) {
-        // try to read 6 tokens
-        char name[20];
-        int R,G,Y;
-        double la, lo;
-        int read6 = fscanf(fp, "%19s %d %d %d %lf %lf", name, &R, &G, &Y, &la, &lo);
-        if (read6 == 6) {
-            strncpy(g->names[i], name, sizeof(g->names[i]) - 1);
-            g->names[i][sizeof(g->names[i]) - 1] = '\0';
-            g->lights[i].red=R; g->lights[i].green=G; g->lights[i].yellow=Y;
-            g->lat[i]=la; g->lon[i]=lo;
+// Follow label f over a road of length w into v and past v's light. A
+// piece of slope 0 is one arrival; a piece of slope 1 alternates between
+// green (arrival unchanged) and red (the next green start) once per phase;
+// steeper pieces are the jumps between those and are timed sample by sample.
+static void profileLink(const Graph *g, const TravelTimeFunction *f, int len, int w, int v,
+                        ProfileBuilder *b) {
+    for (int k = 0; k < f->n; k++) {
+        int end = k + 1 < f->n ? f->t[k+1] : len;
+        int x = f->v[k] + w, s = f->slope[k];
+        if (s == 0) {
+            profileRun(b, x + junctionWait(g, v, x), 0, end - f->t[k]);
+        } else if (s != 1) {
+            for (int t = f->t[k]; t < end; t++, x += s) profileRun(b, x + junctionWait(g, v, x), 0, 1);
         } else {
-            // fallback: try reading a line and parsing name R G Y
-            clearerr(fp);
-            fseek(fp, 0, SEEK_CUR); // portability no-op
-            char line[256];
-            int ok = 0;
-            while (fgets(line, sizeof(line), fp)) {
-                    if (sscanf(line, "%19s %d %d %d", name, &R, &G, &Y) == 4) {
-                    strncpy(g->names[i], name, sizeof(g->names[i]) - 1);
-                    g->names[i][sizeof(g->names[i]) - 1] = '\0';
-                    g->lights[i].red=R; g->lights[i].green=G; g->lights[i].yellow=Y;
-                    g->lat[i]=0.0; g->lon[i]=0.0; // default if old file
-                    ok = 1; break;
+            for (int t = f->t[k]; t < end; ) {
+                int green, cycle;
+                int r = junctionPhase(g, v, x, &green, &cycle);
+                int run = end - t;
+                if (green >= cycle) {
+                    profileRun(b, x, 1, run);
+                } else if (r < green) {
+                    if (green - r < run) run = green - r;
+                    profileRun(b, x, 1, run);
+                } else {
+                    if (cycle - r < run) run = cycle - r;
+                    profileRun(b, x + cycle - r, 0, run);
                 }
-            }
-            if (!ok) {
-                // bad line, set defaults
-                snprintf(g->names[i], sizeof(g->names[i]), "J%d", i);
-                g->lights[i].red=10; g->lights[i].green=5; g->lights[i].yellow=2;
-                g->lat[i]=0.0; g->lon[i]=0.0;
+                t += run;
+                x += run;
             }
         }
     }
+}
 
-    int edges_count = 0;
-    if (fscanf(fp, "%d", &edges_count) != 1) edges_count = 0;
-    for (int i = 0; i < edges_count; i++) {
-        int u, vv, w;
-        if (fscanf(fp, "%d %d %d", &u, &vv, &w) != 3) break;
-        Edge *e1 = newEdge(vv, w);
-        e1->next = g->adj[u];
-        g->adj[u] = e1;
-
-        Edge *e2 = newEdge(u, w);
-        e2->next = g->adj[vv];
-        g->adj[vv] = e2;
+// Pointwise minimum of labels f and h into b; returns whether h is below f
+// anywhere. With b NULL only that is answered. Between breakpoints of
+// either label both are lines, which cross at most once.
+static bool profileMin(const TravelTimeFunction *f, const TravelTimeFunction *h, int len,
+                       ProfileBuilder *b) {
+    bool below = false;
+    for (int t = 0, i = 0, j = 0; t < len; ) {
+        while (i + 1 < f->n && f->t[i+1] <= t) i++;
+        while (j + 1 < h->n && h->t[j+1] <= t) j++;
+        int end = len;
+        if (i + 1 < f->n && f->t[i+1] < end) end = f->t[i+1];
+        if (j + 1 < h->n && h->t[j+1] < end) end = h->t[j+1];
+        int n = end - t;
+        int a = f->v[i] + f->slope[i] * (t - f->t[i]);
+        int c = h->v[j] + h->slope[j] * (t - h->t[j]);
+        long long ds = (long long)h->slope[j] - f->slope[i], gap = (long long)c - a;
+        // samples where h < f: the first m when h rises at least as fast,
+        // otherwise all but the first m
+        int m;
+        if (ds >= 0) {
+            long long lead = gap >= 0 ? 0 : ds == 0 ? n : (-gap + ds - 1) / ds;
+            m = lead < n ? (int)lead : n;
+            if (m > 0) below = true;
+            if (b) {
+                profileRun(b, c, h->slope[j], m);
+                profileRun(b, a + f->slope[i] * m, f->slope[i], n - m);
+            }
+        } else {
+            long long lead = gap < 0 ? 0 : gap / -ds + 1;
+            m = lead < n ? (int)lead : n;
+            if (m < n) below = true;
+            if (b) {
+                profileRun(b, a, f->slope[i], m);
+                profileRun(b, c + h->slope[j] * m, h->slope[j], n - m);
+            }
+        }
+        if (below && !b) return true;
+        t = end;
     }
-
-    fclose(fp);
-    printf("City data loaded from %s\n", filename);
+    return below;
 }
 
-// Write GraphViz DOT file (undirected graph)
-void writeGraphViz(Graph *g, const char *filename) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) { perror("writeGraphViz fopen"); return; }
-    fprintf(fp, "graph City {\n");
-    fprintf(fp, "  overlap=false;\n");
-    fprintf(fp, "  splines=true;\n");
-    // Node labels show name and traffic timing
-    for (int i = 0; i < g->vertices; i++) {
-        fprintf(fp, "  n%d [label=\"%s\\nR:%d G:%d Y:%d\"];\n", i, g->names[i],
-                g->lights[i].red, g->lights[i].green, g->lights[i].yellow);
+// Returns NULL on invalid indices or window (0 <= from <= to <=
+// MAX_DEPARTURE, at most PROFILE_MAX_WINDOW departures)
+ArrivalProfile *profileQuery(Graph *g, QueryContext *qc, int src, int dest, int from, int to) {
+    int n = g->vertices;
+    if (src < 0 || src >= n || dest < 0 || dest >= n) return NULL;
+    if (from < 0 || to < from || to > MAX_DEPARTURE || to - from >= PROFILE_MAX_WINDOW)
+        return NULL;
+    freezeGraph(g);
+    int len = to - from + 1;
+    TravelTimeFunction **label = calloc(n, sizeof(*label));
+    if (!label) {
+        fprintf(stderr, "Out of memory for a %d-departure profile\n", len);
+        exit(1);
     }
-    // Edges: ensure each undirected edge printed once (u<v)
-    for (int u = 0; u < g->vertices; u++) {
-        Edge *p = g->adj[u];
-        while (p) {
-            if (u < p->to) {
-                fprintf(fp, "  n%d -- n%d [label=\"%d\"];\n", u, p->to, p->weight);
+    ProfileBuilder b = {0};
+    profileRun(&b, from, 1, len);
+    label[src] = profileFinish(&b);
+    if (src != dest) {
+        // no route yet: dest's label doubles as the best arrival so far
+        profileRun(&b, INF, 0, len);
+        label[dest] = profileFinish(&b);
+    }
+
+    beginQuery(qc, n);
+    MinHeap *h = qc->heap;
+    insertOrDecreaseKey(h, src, from);
+    while (!isEmpty(h)) {
+        int key;
+        int u = extractMin(h, &key);
+        if (key > label[dest]->hi) break;
+        qc->settled++;
+        if (u == dest) continue;
+        for (int k = g->offsets[u]; k < g->offsets[u+1]; k++) {
+            int v = g->to[k];
+            profileLink(g, label[u], len, g->weight[k], v, &b);
+            TravelTimeFunction *reach = profileFinish(&b);
+            // routes through v can't reach dest before v, so only departures
+            // that get to v ahead of dest's best arrival matter
+            bool improved = profileMin(label[dest], reach, len, NULL);
+            if (improved && label[v]) {
+                improved = profileMin(label[v], reach, len, &b);
+                freeTtf(reach);
+                reach = profileFinish(&b);
             }
-            p = p->next;
+            if (!improved) { freeTtf(reach); continue; }
+            freeTtf(label[v]);
+            label[v] = reach;
+            insertOrDecreaseKey(h, v, reach->lo);
         }
     }
-    fprintf(fp, "}\n");
-    fclose(fp);
-}
+    clearMinHeap(h);
+    free(b.t); free(b.v); free(b.slope);
 
-// Compute waiting time at a traffic light given arrivalTime
-int getWaitingTime(TrafficLight light, int arrivalTime) {
-    int cycle = light.red + light.green + light.yellow;
-    if (cycle <= 0) return 0;
-    int t = arrivalTime % cycle;
-    if (t < light.green) return 0;          // green window
-    return cycle - t;                        // wait till next green
+    // the breakpoint arrays become the profile's (t[] are offsets from `from`)
+    TravelTimeFunction *f = label[dest];
+    label[dest] = NULL;
+    for (int v = 0; v < n; v++) freeTtf(label[v]);
+    free(label);
+    ArrivalProfile *p = malloc(sizeof(ArrivalProfile));
+    *p = (ArrivalProfile){ from, to, f->n, f->t, f->v, f->slope };
+    for (int i = 0; i < p->n; i++) p->depart[i] += from;
+    free(f);
+    return p;
 }
 
-// ========== MIN HEAP IMPLEMENTATION ==========
-MinHeap *createMinHeap(int capacity) {
-    MinHeap *h = (MinHeap *)malloc(sizeof(MinHeap));
-    h->size = 0;
-    for (int i = 0; i < capacity; i++) h->arr[i] = NULL, h->pos[i] = -1;
-    return h;
+void freeArrivalProfile(ArrivalProfile *p) {
+    if (!p) return;
+    free(p->depart);    // arrival and slope share its block
+    free(p);
 }
 
-void swapHeapNode(HeapNode **a, HeapNode **b) {
-    HeapNode *t = *a; *a = *b; *b = t;
+// ========== LATEST DEPARTURE (reverse time-dependent) ==========
+// Runs backwards from dest. dist[v] is the latest time a vehicle can be
+// past v's light (leave v, for src) and still be past dest's light by the
+// deadline. Roads are two-way, so v's own arcs are the roads into it:
+// over u -> v of length w, dist[u] = junctionLatestArrival(v, dist[v]) - w.
+// That never exceeds dist[v] and never drops when dist[v] grows, so
+// junctions are settled latest first (negated keys on the min-heap) and are
+// final once settled. parent[u] is the next junction towards dest.
+static void latestSearch(Graph *g, QueryContext *qc, int src, int dest, int deadline) {
+    beginQuery(qc, g->vertices);
+    MinHeap *h = qc->heap;
+    qcSet(qc, dest, deadline, -1);
+    insertOrDecreaseKey(h, dest, -deadline);
+    while (!isEmpty(h)) {
+        int key;
+        int v = extractMin(h, &key);
+        qc->settled++;
+        if (v == src) break;
+        int arrive = junctionLatestArrival(g, v, -key);
+        for (int k = g->offsets[v]; k < g->offsets[v+1]; k++) {
+            int u = g->to[k];
+            int leave = arrive - g->weight[k];
+            if (leave < 0) continue;    // would have to leave before time 0
+            if (qc->stamp[u] != qc->generation || leave > qc->dist[u]) {
+                qcSet(qc, u, leave, v);
+                insertOrDecreaseKey(h, u, -leave);
+            }
+        }
+    }
+    clearMinHeap(h);
 }
 
-void minHeapify(MinHeap *h, int idx) {
-    int smallest = idx;
-    int left = 2*idx + 1;
-    int right = 2*idx + 2;
-    if (left < h->size && h->arr[left]->dist < h->arr[smallest]->dist)
-        smallest = left;
-    if (right < h->size && h->arr[right]->dist < h->arr[smallest]->dist)
-        smallest = right;
-    if (smallest != idx) {
-        h->pos[h->arr[smallest]->v] = idx;
-        h->pos[h->arr[idx]->v] = smallest;
-        swapHeapNode(&h->arr[smallest], &h->arr[idx]);
-        minHeapify(h, smallest);
-    }
+// Latest departure from src (>= 0) that reaches dest by the deadline, found
+// in one reverse search. path (room for g->vertices junctions, or NULL)
+// receives the route in travel order; res->depart is the departure,
+// res->arrival the arrival on that route (<= deadline). res->cost is INF
+// (depart -1) when no departure makes it. Returns false on invalid indices
+// or a deadline outside [0, MAX_DEPARTURE].
+bool latestDeparture(Graph *g, QueryContext *qc, int src, int dest, int deadline,
+                     int *path, RouteResult *res) {
+    int n = g->vertices;
+    if (src < 0 || src >= n || dest < 0 || dest >= n) return false;
+    if (deadline < 0 || deadline > MAX_DEPARTURE) return false;
+    freezeGraph(g);
+    latestSearch(g, qc, src, dest, deadline);
+    res->algo = ALGO_DIJKSTRA;
+    res->settled = qc->settled;
+    res->path_len = 0;
+    res->cost = res->time = res->arrival = INF;
+    res->depart = -1;
+    if (qc->stamp[src] != qc->generation) return true;
+    int *route = path ? path : malloc(n * sizeof(int));
+    int len = 0;
+    for (int v = src; v != -1; v = qc->parent[v]) route[len++] = v;
+    res->depart = qc->dist[src];
+    res->cost = res->time = routeTime(g, route, len, res->depart);
+    res->arrival = res->depart + res->time;
+    if (path) res->path_len = len;
+    else free(route);
+    return true;
 }
 
-bool isEmpty(MinHeap *h) { return h->size == 0; }
+// ========== TRAVEL-TIME MATRIX ==========
+// One time-dependent Dijkstra per source, stopped once every target is
+// settled. Sources are handed out to worker threads through a shared
+// counter; each worker owns its QueryContext and writes only its own rows.
+typedef struct {
+    Graph *g;
+    const int *sources, *targets;
+    int ns, nt;
+    int depart;             // clock time every source is left at
+    const bool *wanted;     // wanted[v]: v is one of the targets
+    int distinct;           // number of distinct targets
+    int *out;
+    atomic_int next;
+} MatrixJob;
 
-// extract min node
-HeapNode *extractMin(MinHeap *h) {
-    if (isEmpty(h)) return NULL;
-    HeapNode *root = h->arr[0];
-    HeapNode *lastNode = h->arr[h->size - 1];
-    h->arr[0] = lastNode;
-    h->pos[lastNode->v] = 0;
-    h->pos[root->v] = -1;
-    h->size--;
-    minHeapify(h, 0);
-    return root;
+static void matrixRow(MatrixJob *job, QueryContext *qc, int row) {
+    Graph *g = job->g;
+    int src = job->sources[row], left = job->distinct;
+    beginQuery(qc, g->vertices);
+    MinHeap *h = qc->heap;
+    qcSet(qc, src, job->depart, -1);
+    insertOrDecreaseKey(h, src, job->depart);
+    while (!isEmpty(h) && left > 0) {
+        int du;
+        int u = extractMin(h, &du);
+        if (job->wanted[u]) left--;
+        for (int k = g->offsets[u], end = g->offsets[u+1]; k < end; ) {
+            int reach[WAIT_BATCH];
+            int n = arcReach(g, du, k, end, reach);
+            for (int i = 0; i < n; i++, k++) {
+                int v = g->to[k];
+                int newDist = reach[i];
+                if (newDist < qcDist(qc, v)) {
+                    qcSet(qc, v, newDist, u);
+                    insertOrDecreaseKey(h, v, newDist);
+                }
+            }
+        }
+    }
+    clearMinHeap(h);
+    int *out = &job->out[(size_t)row * job->nt];
+    for (int j = 0; j < job->nt; j++) {
+        int arrival = qcDist(qc, job->targets[j]);
+        out[j] = arrival == INF ? INF : arrival - job->depart;
+    }
 }
 
-// decrease key for vertex v to new dist
-void decreaseKey(MinHeap *h, int v, int dist) {
-    int i = h->pos[v];
-    if (i == -1) return;
-    h->arr[i]->dist = dist;
-    while (i && h->arr[i]->dist < h->arr[(i-1)/2]->dist) {
-        h->pos[h->arr[i]->v] = (i-1)/2;
-        h->pos[h->arr[(i-1)/2]->v] = i;
-        swapHeapNode(&h->arr[i], &h->arr[(i-1)/2]);
-        i = (i-1)/2;
-    }
+static void *matrixWorker(void *arg) {
+    MatrixJob *job = arg;
+    QueryContext *qc = createQueryContext(job->g->vertices);
+    int row;
+    while ((row = atomic_fetch_add(&job->next, 1)) < job->ns)
+        matrixRow(job, qc, row);
+    freeQueryContext(qc);
+    return NULL;
 }
 
-bool isInMinHeap(MinHeap *h, int v) { return h->pos[v] != -1; }
+// Travel times from every source to every target departing at clock time
+// depart, row-major (ns x nt, INF if unreachable); free() the result.
+// threads <= 0 uses every online core. Returns NULL on an invalid junction
+// index or departure time.
+int *travelTimeMatrix(Graph *g, const int *sources, int ns, const int *targets, int nt, int depart,
+                      int threads) {
+    int n = g->vertices;
+    if (depart < 0 || depart > MAX_DEPARTURE) return NULL;
+    for (int i = 0; i < ns; i++)
+        if (sources[i] < 0 || sources[i] >= n) return NULL;
+    for (int j = 0; j < nt; j++)
+        if (targets[j] < 0 || targets[j] >= n) return NULL;
+    freezeGraph(g);   // workers only read the CSR
 
-void freeMinHeap(MinHeap *h) {
-    for (int i = 0; i < h->size; i++) if (h->arr[i]) free(h->arr[i]);
-    free(h);
-}
+    size_t cells = (size_t)ns * nt;
+    int *out = malloc((cells ? cells : 1) * sizeof(int));
+    bool *wanted = calloc(n ? n : 1, sizeof(bool));
+    if (!out || !wanted) {
+        fprintf(stderr, "Out of memory for a %d x %d matrix\n", ns, nt);
+        exit(1);
+    }
+    MatrixJob job = { g, sources, targets, ns, nt, depart, wanted, 0, out, 0 };
+    for (int j = 0; j < nt; j++) {
+        if (!wanted[targets[j]]) job.distinct++;
+        wanted[targets[j]] = true;
+    }
 
-// ========== LEAFLET MAP EXPORT ==========
-static void js_escape_name(const char *src, char *dst, size_t dstsz) {
-    // very small escaper: replace " with ' and backslash with slash
-    size_t j=0;
-    for (size_t i=0; src[i] && j+1<dstsz; i++) {
-        char c = src[i];
-        if (c=='"' || c=='\\') c = '\'';
-        dst[j++] = c;
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > ns) threads = ns;
+    if (threads < 1) threads = 1;
+    pthread_t *tid = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&tid[started], NULL, matrixWorker, &job) != 0) break;
+        started++;
     }
-    dst[j] = '\0';
+    matrixWorker(&job);   // the calling thread works too
+    for (int t = 0; t < started; t++) pthread_join(tid[t], NULL);
+    free(tid);
+    free(wanted);
+    return out;
 }
 
-void exportLeafletMap(Graph *g, int *path, int path_len, const char *filename) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) { perror("exportLeafletMap fopen"); return; }
+// ========== BATCH QUERIES ==========
+// Queries are read in chunks. Each chunk is answered by a pool of threads
+// sharing the read-only graph, each with its own QueryContext; the threads
+// are started once per batch and wait between chunks. A worker
+// starts with its own contiguous range of the chunk and takes from the back
+// of it; an idle worker steals the front half of another worker's range, so
+// a few long routes can't hold up the rest. Results are written in input
+// order once the chunk is done.
+#define BATCH_CHUNK 65536
 
-    fprintf(fp,
-    "<!doctype html><html><head><meta charset='utf-8'>"
-    "<meta name='viewport' content='width=device-width, initial-scale=1'>"
-    "<title>City Map - India</title>"
-    "<link rel='stylesheet' href='https://unpkg.com/leaflet@1.9.4/dist/leaflet.css'/>"
-    "<style>html,body,#map{height:100%%;margin:0;} .edge-label{background:transparent;border:none;font-weight:600;}</style>"
-    "</head><body><div id='map'></div>"
-    "<script src='https://unpkg.com/leaflet@1.9.4/dist/leaflet.js'></script>"
-    "<script src='https://cdnjs.cloudflare.com/ajax/libs/leaflet.polylinedecorator/1.7.0/leaflet.polylineDecorator.min.js'></script>"
-    "<script>\n");
+enum { BATCH_PENDING, BATCH_ROUTE, BATCH_NO_ROUTE, BATCH_INVALID };
 
-    // Center over India
-    fprintf(fp,
-    "var map = L.map('map').setView([22.5937, 78.9629], 5);\n"
-    "L.tileLayer('https://{s}.tile.openstreetmap.org/{z}/{x}/{y}.png', {"
-    "maxZoom: 18, attribution: '&copy; OpenStreetMap contributors'}).addTo(map);\n");
+typedef struct {
+    int src, dest;
+    int depart;
+    int status;
+    int time;
+    int worker;         // whose route buffer holds the path
+    int path_len;
+    size_t path_off;
+} BatchQuery;
 
-    // Nodes array
-    fprintf(fp, "var nodes = [\n");
-    for (int i = 0; i < g->vertices; i++) {
-        char safe[64]; js_escape_name(g->names[i], safe, sizeof(safe));
-        fprintf(fp, "  {id:%d, name:\"%s\", lat:%lf, lon:%lf}%s\n",
-                i, safe, g->lat[i], g->lon[i], (i+1<g->vertices)? ",":"");
-    }
-    fprintf(fp, "];\n");
+// Query indices [lo, hi) still owned by a worker, packed as hi << 32 | lo
+// so the owner and thieves each claim work with a single CAS. Padded to a
+// cache line so neighbouring deques don't share one.
+typedef struct {
+    _Atomic unsigned long long range;
+    char pad[64 - sizeof(unsigned long long)];
+} BatchDeque;
 
-    // Edges array (u<v only)
-    fprintf(fp, "var edges = [\n");
-    int first = 1;
-    for (int u = 0; u < g->vertices; u++) {
-        for (Edge *p = g->adj[u]; p; p = p->next) {
-            int v = p->to;
-            if (u < v) {
-                fprintf(fp, "  %s{u:%d, v:%d, w:%d}\n", first?"":",", u, v, p->weight);
-                first = 0;
-            }
-        }
-    }
-    fprintf(fp, "];\n");
+typedef struct {
+    QueryContext *qc;
+    int *path;          // scratch route (vertices entries)
+    int *routes;        // routes found in the current chunk, back to back
+    size_t used, cap;
+} BatchWorker;
 
-    // Shortest path indices
-    fprintf(fp, "var sp = [");
-    for (int i = 0; i < path_len; i++) {
-        fprintf(fp, "%d%s", path[i], (i+1<path_len)? ",":"");
-    }
-    fprintf(fp, "];\n");
+typedef struct {
+    Graph *g;
+    RouteAlgo algo;
+    BatchQuery *q;
+    BatchDeque *deque;
+    BatchWorker *worker;
+    int nworkers;
+    // helper threads 1..started wait on `go` for the next round (a chunk,
+    // or quit) and report on `done` when their sweep is over
+    pthread_mutex_t lock;
+    pthread_cond_t go, done;
+    unsigned round;
+    int busy;
+    bool quit;
+    pthread_t *tid;
+    int started;
+} BatchPool;
 
-    // Draw markers
-    fprintf(fp,
-    "nodes.forEach(n=>{\n"
-    "  var m = L.marker([n.lat, n.lon]).addTo(map);\n"
-    "  m.bindPopup('<b>'+n.name+'</b>');\n"
-    "});\n"
-    "function pt(id){ let n = nodes.find(x=>x.id===id); return [n.lat, n.lon]; }\n");
+typedef struct {
+    BatchPool *pool;
+    int id;
+} BatchThread;
 
-    // Draw all edges
-    fprintf(fp,
-    "edges.forEach(e=>{\n"
-    "  var line = L.polyline([pt(e.u), pt(e.v)], {weight:3, opacity:0.6}).addTo(map);\n"
-    "  var a=pt(e.u), b=pt(e.v);\n"
-    "  var mid=[(a[0]+b[0])/2,(a[1]+b[1])/2];\n"
-    "  L.marker(mid,{opacity:0}).addTo(map)\n"
-    "    .bindTooltip(String(e.w),{permanent:true,direction:'center',className:'edge-label'});\n"
-    "});\n");
+static inline unsigned long long batchRange(unsigned lo, unsigned hi) {
+    return (unsigned long long)hi << 32 | lo;
+}
 
-    // Draw shortest path (with arrowheads)
-    fprintf(fp,
-    "if (sp.length>1){\n"
-    "  var coords=[]; for (var i=0;i<sp.length;i++){ coords.push(pt(sp[i])); }\n"
-    "  var spLine = L.polyline(coords, {color:'red', weight:6, opacity:0.9}).addTo(map);\n"
-    "  spLine.bindPopup('Shortest Path');\n"
-    "  try {\n"
-    "    var decorator = L.polylineDecorator(spLine, {patterns: [\n"
-    "      {offset: '5%%', repeat: '15%%', symbol: L.Symbol.arrowHead({pixelSize: 10, polygon: false, pathOptions: {stroke: true, color: 'red'}})}\n"
-    "    ]}).addTo(map);\n"
-    "  } catch(e) { console.warn('PolylineDecorator not available', e); }\n"
-    "  map.fitBounds(coords, {padding:[40,40]});\n"
-    "} else { // if no path, fit all nodes\n"
-    "  var all=[]; nodes.forEach(n=>all.push([n.lat,n.lon]));\n"
-    "  if (all.length>0) map.fitBounds(all, {padding:[40,40]});\n"
-    "}\n");
+// Owner end: take the last query of the range (-1 when empty)
+static int batchPop(BatchDeque *d) {
+    unsigned long long r = atomic_load(&d->range);
+    for (;;) {
+        unsigned lo = (unsigned)r, hi = (unsigned)(r >> 32);
+        if (lo >= hi) return -1;
+        if (atomic_compare_exchange_weak(&d->range, &r, batchRange(lo, hi - 1)))
+            return (int)(hi - 1);
+    }
+}
 
-    fprintf(fp, "</script></body></html>");
-    fclose(fp);
-    printf("Interactive India map exported to %s\n", filename);
+// Thief end: move the front half of victim's range into d (false if empty)
+static bool batchSteal(BatchDeque *d, BatchDeque *victim) {
+    unsigned long long r = atomic_load(&victim->range);
+    for (;;) {
+        unsigned lo = (unsigned)r, hi = (unsigned)(r >> 32);
+        if (lo >= hi) return false;
+        unsigned mid = lo + (hi - lo + 1) / 2;
+        if (atomic_compare_exchange_weak(&victim->range, &r, batchRange(mid, hi))) {
+            atomic_store(&d->range, batchRange(lo, mid));
+            return true;
+        }
+    }
 }
 
-// ========== DIJKSTRA (time-dependent) ==========
-void dijkstra(Graph *g, int src, int dest) {
-    int n = g->vertices;
-    if (src < 0 || src >= n || dest < 0 || dest >= n) {
-        printf("Invalid source/destination indices.\n");
+static void batchAnswer(BatchPool *pool, int id, BatchQuery *q) {
+    BatchWorker *w = &pool->worker[id];
+    if (q->status != BATCH_PENDING) return;
+    RouteResult res;
+    if (!routeQuery(pool->g, w->qc, q->src, q->dest, q->depart, pool->algo, w->path, &res)) {
+        q->status = BATCH_INVALID;
+        return;
+    }
+    if (res.cost == INF) {
+        q->status = BATCH_NO_ROUTE;
         return;
     }
+    if (w->used + res.path_len > w->cap) {
+        while (w->used + res.path_len > w->cap) w->cap = w->cap ? 2 * w->cap : 4096;
+        w->routes = realloc(w->routes, w->cap * sizeof(int));
+        if (!w->routes) { fprintf(stderr, "Out of memory storing batch routes\n"); exit(1); }
+    }
+    memcpy(&w->routes[w->used], w->path, res.path_len * sizeof(int));
+    q->status = BATCH_ROUTE;
+    q->time = res.time;
+    q->worker = id;
+    q->path_len = res.path_len;
+    q->path_off = w->used;
+    w->used += res.path_len;
+}
 
-    int dist[MAX];
-    int parent[MAX];
-    for (int i = 0; i < n; i++) {
-        dist[i] = INF;
-        parent[i] = -1;
+// Work on the current chunk as worker id until nothing is left to steal
+static void batchSweep(BatchPool *pool, int id) {
+    BatchDeque *own = &pool->deque[id];
+    for (;;) {
+        int i;
+        while ((i = batchPop(own)) >= 0) batchAnswer(pool, id, &pool->q[i]);
+        // nothing is added once a chunk starts, so one empty sweep means done
+        bool stole = false;
+        for (int k = 1; k < pool->nworkers && !stole; k++)
+            stole = batchSteal(own, &pool->deque[(id + k) % pool->nworkers]);
+        if (!stole) return;
     }
-    MinHeap *h = createMinHeap(n);
+}
 
+static void *batchWorker(void *arg) {
+    BatchThread *t = arg;
+    BatchPool *pool = t->pool;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->round == seen && !pool->quit) pthread_cond_wait(&pool->go, &pool->lock);
+        seen = pool->round;
+        bool quit = pool->quit;
+        pthread_mutex_unlock(&pool->lock);
+        if (quit) return NULL;
+        batchSweep(pool, t->id);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
 
-    // initialize heap nodes
-    for (int v = 0; v < n; v++) {
-        HeapNode *hn = (HeapNode *)malloc(sizeof(HeapNode));
-        hn->v = v;
-        hn->dist = INF;
-        h->arr[h->size] = hn;
-        h->pos[v] = h->size;
-        h->size++;
+// Start the pool's helper threads; worker 0 is the calling thread
+static void batchStart(BatchPool *pool, BatchThread *arg) {
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->go, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->tid = malloc(pool->nworkers * sizeof(pthread_t));
+    for (int t = 0; t < pool->nworkers; t++) arg[t] = (BatchThread){ pool, t };
+    for (int t = 1; t < pool->nworkers; t++) {
+        if (pthread_create(&pool->tid[pool->started], NULL, batchWorker, &arg[t]) != 0) break;
+        pool->started++;
     }
+}
 
-    // set src dist = 0
-    dist[src] = 0;
-    h->arr[h->pos[src]]->dist = 0;
-    decreaseKey(h, src, 0);
+static void batchStop(BatchPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 0; t < pool->started; t++) pthread_join(pool->tid[t], NULL);
+    free(pool->tid);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->go);
+    pthread_mutex_destroy(&pool->lock);
+}
 
-    while (!isEmpty(h)) {
-        HeapNode *hn = extractMin(h);
-        if (!hn) break;
-        int u = hn->v;
-        int du = hn->dist;
-        free(hn);
+// Answer q[0..n-1] on every worker of the pool
+static void batchRunChunk(BatchPool *pool, int n) {
+    int workers = pool->nworkers;
+    for (int t = 0; t < workers; t++) {
+        unsigned lo = (unsigned)((long long)n * t / workers);
+        unsigned hi = (unsigned)((long long)n * (t + 1) / workers);
+        atomic_store(&pool->deque[t].range, batchRange(lo, hi));
+        pool->worker[t].used = 0;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->round++;
+    pool->busy = pool->started;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+    batchSweep(pool, 0);    // the calling thread works too (and steals the rest
+                            // of any worker that failed to start)
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
 
-        if (du == INF) break;
-        if (u == dest) break;
+static void batchWrite(BatchPool *pool, int n, FILE *out) {
+    for (int i = 0; i < n; i++) {
+        BatchQuery *q = &pool->q[i];
+        if (q->status == BATCH_INVALID) {
+            fprintf(out, "%d %d invalid\n", q->src, q->dest);
+            continue;
+        }
+        if (q->status == BATCH_NO_ROUTE) {
+            fprintf(out, "%d %d -\n", q->src, q->dest);
+            continue;
+        }
+        fprintf(out, "%d %d %d", q->src, q->dest, q->time);
+        const int *path = &pool->worker[q->worker].routes[q->path_off];
+        for (int k = 0; k < q->path_len; k++) fprintf(out, " %d", path[k]);
+        fputc('\n', out);
+    }
+}
 
-        Edge *p = g->adj[u];
-        while (p) {
-            int v = p->to;
-            int w = p->weight;
-            if (h->pos[v] != -1) {
-                int arrival = dist[u] + w;
-                int wait = getWaitingTime(g->lights[v], arrival);
-                int newDist = dist[u] + w + wait;
-                if (newDist < dist[v]) {
-                    dist[v] = newDist;
-                    parent[v] = u;
-                    int idx = h->pos[v];
-                    if (idx != -1 && h->arr[idx]) {
-                        h->arr[idx]->dist = newDist;
-                        decreaseKey(h, v, newDist);
-                    }
-                }
+// Each input line is "src dest [departure_time]" (default 0); blank lines
+// and lines starting with '#' are skipped. One output line per query, in
+// input order:
+//   src dest time j0 j1 ... jk    (travel time from the departure, route junctions)
+//   src dest -                    (no route)
+//   src dest invalid              (index or departure time out of range)
+// Malformed lines are reported on stderr. threads <= 0 uses every online
+// core. Returns the number of queries.
+long runBatch(Graph *g, FILE *in, FILE *out, RouteAlgo algo, int threads) {
+    freezeGraph(g);
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    BatchPool pool = { .g = g, .algo = prepareSearch(g, algo), .nworkers = threads };
+    pool.q = malloc(BATCH_CHUNK * sizeof(BatchQuery));
+    pool.deque = aligned_alloc(64, threads * sizeof(BatchDeque));
+    pool.worker = calloc(threads, sizeof(BatchWorker));
+    for (int t = 0; t < threads; t++) {
+        pool.worker[t].qc = createQueryContext(g->vertices);
+        pool.worker[t].path = malloc((g->vertices ? g->vertices : 1) * sizeof(int));
+    }
+    BatchThread *arg = malloc(threads * sizeof(BatchThread));
+    batchStart(&pool, arg);
+
+    char *line = NULL;
+    size_t cap = 0;
+    long lineno = 0, queries = 0;
+    bool eof = false;
+    while (!eof) {
+        int n = 0;
+        while (n < BATCH_CHUNK) {
+            if (getline(&line, &cap, in) == -1) { eof = true; break; }
+            lineno++;
+            char *p = line;
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p == '\n' || *p == '\r' || *p == '\0' || *p == '#') continue;
+            BatchQuery *q = &pool.q[n];
+            q->depart = 0;
+            int used = 0, more = 0;
+            bool ok = sscanf(p, "%d %d%n", &q->src, &q->dest, &used) == 2;
+            if (ok) {
+                p += used;
+                if (sscanf(p, "%d%n", &q->depart, &more) == 1) p += more;
+                while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+                ok = *p == '\0';   // nothing may follow the numbers
             }
-            p = p->next;
+            if (!ok) {
+                fprintf(stderr, "line %ld: expected src dest [departure_time]\n", lineno);
+                continue;
+            }
+            q->status = BATCH_PENDING;
+            n++;
         }
+        if (n == 0) break;
+        batchRunChunk(&pool, n);
+        batchWrite(&pool, n, out);
+        queries += n;
     }
 
-    // Build path
-    if (dist[dest] == INF) {
-        printf("\nNo path found from %s to %s\n", g->names[src], g->names[dest]);
-        // still export map without path
-        int dummy[1]={0};
-        exportLeafletMap(g, dummy, 0, "map_india.html");
-    } else {
-        printf("\nShortest Time from %s to %s = %d units\n",
-               g->names[src], g->names[dest], dist[dest]);
-        printf("\nPath Travel Summary:\n");
-        int path[MAX];
-        int idx = 0;
-        for (int v = dest; v != -1; v = parent[v])
-            path[idx++] = v;
-        for (int i = idx - 1; i >= 0; i--) {
-            printf("%s", g->names[path[i]]);
-            if (i != 0) printf(" -> ");
-        }
-        printf("\nTotal Time Taken: %d units\n", dist[dest]);
+    free(line);
+    batchStop(&pool);
+    free(arg);
+    for (int t = 0; t < threads; t++) {
+        freeQueryContext(pool.worker[t].qc);
+        free(pool.worker[t].path);
+        free(pool.worker[t].routes);
+    }
+    free(pool.worker);
+    free(pool.deque);
+    free(pool.q);
+    return queries;
+}
 
-        // Export map with highlighted shortest path
-        // Note: path[] is currently reversed, but we printed in forward order.
-        // Build forward array for the map:
-        int forward[MAX];
-        for (int i = 0; i < idx; i++) forward[i] = path[idx-1-i];
-        exportLeafletMap(g, forward, idx, "map_india.html");
+// Free all graph memory and leave an empty graph behind
+void freeGraph(Graph *g) {
+    clearEdgePool(&g->pool, false);
+    free(g->adj);
+    if (g->mapping) {
+        munmap(g->mapping, g->mapping_size);
+    } else {
+        free(g->offsets); free(g->to); free(g->weight);
+        free(g->signal); free(g->lights); free(g->names);
+        free(g->lat); free(g->lon);
     }
+    freeContractionHierarchy(g->ch);
+    freeTDContractionHierarchy(g->tdch);
+    freeLandmarks(g->alt);
+    initGraph(g);
+}
 
-    freeMinHeap(h);
+// ========== MAIN PROGRAM ==========
+// filename with its extension replaced, e.g. city_data.txt -> city_data.ch
+static void siblingPath(const char *filename, const char *ext, char *out, size_t size) {
+    snprintf(out, size, "%s", filename);
+    char *dot = strrchr(out, '.');
+    char *slash = strrchr(out, '/');
+    if (dot && (!slash || dot > slash)) *dot = '\0';
+    strncat(out, ext, size - strlen(out) - 1);
 }
 
-// Free adjacency list memory
-void freeGraph(Graph *g) {
-    for (int i = 0; i < g->vertices; i++) {
-        Edge *p = g->adj[i];
-        while (p) {
-            Edge *tmp = p;
-            p = p->next;
-            free(tmp);
+static bool parseRouteAlgo(const char *name, RouteAlgo *algo) {
+    static const struct { const char *name; RouteAlgo algo; } names[] = {
+        {"dijkstra", ALGO_DIJKSTRA}, {"astar", ALGO_ASTAR}, {"bidir", ALGO_BIDIR},
+        {"ch", ALGO_CH}, {"tdch", ALGO_TDCH}, {"alt", ALGO_ALT},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (strcmp(name, names[i].name) == 0) { *algo = names[i].algo; return true; }
+    return false;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--graph FILE]                       interactive menu\n"
+            "       %s [--graph FILE] --snapshot OUT.bin    write a binary snapshot\n"
+            "       %s [--graph FILE] [--algo NAME] [--threads N] --batch QUERIES|- [-o OUT]\n"
+            "algorithms: dijkstra astar bidir ch tdch alt\n", prog, prog, prog);
+}
+
+// Non-interactive mode: replay a query file (or stdin) against one graph
+static int batchMain(Graph *g, const char *filename, const char *chFilename, RouteAlgo algo,
+                     const char *queries, const char *outname, int threads) {
+    if (!loadGraphFromFile(g, filename)) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 1;
+    }
+    FILE *in = strcmp(queries, "-") == 0 ? stdin : fopen(queries, "r");
+    if (!in) { perror(queries); return 1; }
+    FILE *out = outname ? fopen(outname, "w") : stdout;
+    if (!out) { perror(outname); return 1; }
+    static char outbuf[1 << 16];
+    setvbuf(out, outbuf, _IOFBF, sizeof(outbuf));
+    if (algo == ALGO_CH || algo == ALGO_TDCH) {
+        // reuse the saved hierarchy next to the graph file when it matches
+        freezeGraph(g);
+        if (!(g->ch = loadContractionHierarchy(g, chFilename))) {
+            g->ch = buildContractionHierarchy(g);
+            saveContractionHierarchy(g->ch, chFilename);
         }
-        g->adj[i] = NULL;
     }
+    long n = runBatch(g, in, out, algo, threads);
+    if (in != stdin) fclose(in);
+    fflush(out);
+    if (out != stdout) fclose(out);
+    fprintf(stderr, "%ld queries answered\n", n);
+    freeGraph(g);
+    return 0;
 }
 
-// ========== MAIN PROGRAM ==========
-int main() {
+int main(int argc, char **argv) {
     Graph city;
     initGraph(&city);
     int choice;
     const char *filename = "city_data.txt";
+    const char *batchFile = NULL, *outFile = NULL, *snapshotFile = NULL;
+    int threads = 0;
+    RouteAlgo routeAlgo = ALGO_DIJKSTRA;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--graph") == 0 && more) filename = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && more) batchFile = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && more) outFile = argv[++i];
+        else if (strcmp(argv[i], "--snapshot") == 0 && more) snapshotFile = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && more) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--algo") == 0 && more && parseRouteAlgo(argv[i+1], &routeAlgo)) i++;
+        else { usage(argv[0]); return 2; }
+    }
+    char chFilename[256];
+    siblingPath(filename, ".ch", chFilename, sizeof(chFilename));
+    if (snapshotFile) {
+        if (!loadGraphFromFile(&city, filename)) {
+            fprintf(stderr, "Cannot open %s\n", filename);
+            return 1;
+        }
+        bool ok = saveGraphSnapshot(&city, snapshotFile);
+        if (ok) printf("Snapshot of %d junctions written to %s\n", city.vertices, snapshotFile);
+        freeGraph(&city);
+        return ok ? 0 : 1;
+    }
+    if (batchFile)
+        return batchMain(&city, filename, chFilename, routeAlgo, batchFile, outFile, threads);
 
     printf("=== SMART TRAFFIC MANAGEMENT SYSTEM (AdjList + PQ + India Map) ===\n");
-    loadGraphFromFile(&city, filename);
+    if (loadGraphFromFile(&city, filename))
+        printf("City data loaded from %s\n", filename);
+    else
+        printf("File not found! Starting fresh.\n");
 
     do {
         printf("\nMenu:\n");
@@ -555,6 +3985,10 @@ int main() {
         printf("3. Find Shortest Path\n");
         printf("4. Save & Exit\n");
         printf("5. Export Interactive Map (India)\n");
+        printf("6. Select Routing Algorithm\n");
+        printf("7. Travel-Time Matrix\n");
+        printf("8. Arrival Profile (every departure in a window)\n");
+        printf("9. Latest Departure (arrive by a deadline)\n");
         printf("Enter your choice: ");
         if (scanf("%d", &choice) != 1) {
             while (getchar() != '\n');
@@ -564,23 +3998,31 @@ int main() {
         if (choice == 1) {
             freeGraph(&city);
 
-            printf("Enter number of junctions (max %d): ", MAX);
+            printf("Enter number of junctions: ");
             int vcount;
             scanf("%d", &vcount);
-            if (vcount < 1 || vcount > MAX) {
-                printf("Invalid number; must be 1..%d\n", MAX);
+            if (vcount < 1) {
+                printf("Invalid number; must be at least 1\n");
                 continue;
             }
-            city.vertices = vcount;
-            for (int i = 0; i < city.vertices; i++) {
+            for (int i = 0; i < vcount; i++) {
+                char name[20];
+                TrafficLight L = {0};
+                char order[8];
+                double la, lo;
                 printf("\nJunction %d name: ", i);
-                scanf("%19s", city.names[i]);
-                printf("Enter traffic light timings (Red Green Yellow) for %s: ", city.names[i]);
-                scanf("%d %d %d", &city.lights[i].red,
-                      &city.lights[i].green, &city.lights[i].yellow);
-                printf("Enter latitude and longitude for %s (e.g., 28.6139 77.2090): ", city.names[i]);
-                scanf("%lf %lf", &city.lat[i], &city.lon[i]);
-                city.adj[i] = NULL;
+                scanf("%19s", name);
+                printf("Enter traffic light timings (Red Green Yellow) for %s: ", name);
+                scanf("%d %d %d", &L.red, &L.green, &L.yellow);
+                printf("Enter phase offset and order for %s (e.g. 0 GYR): ", name);
+                if (scanf("%d %7s", &L.offset, order) != 2 || !parsePhaseOrder(order, &L.order)) {
+                    printf("Unknown phase order; using 0 GYR\n");
+                    L.offset = 0;
+                    L.order = PHASES_GYR;
+                }
+                printf("Enter latitude and longitude for %s (e.g., 28.6139 77.2090): ", name);
+                scanf("%lf %lf", &la, &lo);
+                addJunction(&city, name, L, la, lo);
             }
 
             int e;
@@ -592,6 +4034,7 @@ int main() {
                 scanf("%d %d %d", &u, &v, &w);
                 addEdge(&city, u, v, w);
             }
+            freezeGraph(&city);
         }
 
         else if (choice == 2) {
@@ -599,15 +4042,21 @@ int main() {
         }
 
         else if (choice == 3) {
-            int s, d;
+            int s, d, dep;
             printf("Enter source and destination index: ");
             scanf("%d %d", &s, &d);
-            dijkstra(&city, s, d);
+            printf("Enter departure time (0 = start of the light cycles): ");
+            if (scanf("%d", &dep) != 1) dep = 0;
+            findShortestPath(&city, s, d, dep, routeAlgo, "map_india.html");
             printf("Open map_india.html to see the route highlighted.\n");
         }
 
         else if (choice == 4) {
-            saveGraphToFile(&city, filename);
+            if (isGraphSnapshot(filename)) {
+                if (saveGraphSnapshot(&city, filename))
+                    printf("City data saved to %s\n", filename);
+            }
+            else saveGraphToFile(&city, filename, true);
             printf("Exiting...\n");
         }
 
@@ -618,6 +4067,144 @@ int main() {
             printf("Open map_india.html to view the current city network.\n");
         }
 
+        else if (choice == 6) {
+            int a;
+            printf("1. Dijkstra\n");
+            printf("2. A* (great-circle lower bound)\n");
+            printf("3. Bidirectional\n");
+            printf("4. Contraction Hierarchy (road lengths only)\n");
+            printf("5. Time-dependent Contraction Hierarchy\n");
+            printf("6. ALT (landmarks)\n");
+            printf("Enter algorithm: ");
+            if (scanf("%d", &a) != 1) a = 0;
+            if (a == 1) routeAlgo = ALGO_DIJKSTRA;
+            else if (a == 2) routeAlgo = ALGO_ASTAR;
+            else if (a == 3) routeAlgo = ALGO_BIDIR;
+            else if (a == 4) {
+                prepareContractionHierarchy(&city, chFilename);
+                routeAlgo = ALGO_CH;
+            }
+            else if (a == 5) {
+                prepareContractionHierarchy(&city, chFilename);
+                if (!city.tdch) {
+                    printf("Building time-dependent contraction hierarchy...\n");
+                    city.tdch = buildTDContractionHierarchy(&city);
+                }
+                if (city.tdch) {
+                    printf("Time-dependent hierarchy ready (period %d, %d arcs)\n",
+                           city.tdch->period, city.tdch->arcs);
+                    routeAlgo = ALGO_TDCH;
+                } else {
+                    printf("Light cycles have no common period up to %d; keeping the current algorithm.\n",
+                           TDCH_MAX_PERIOD);
+                }
+            }
+            else if (a == 6) {
+                int k, sel;
+                printf("Number of landmarks (e.g. %d): ", ALT_DEFAULT_LANDMARKS);
+                if (scanf("%d", &k) != 1 || k < 1) k = ALT_DEFAULT_LANDMARKS;
+                printf("Selection (1 = farthest, 2 = avoid): ");
+                if (scanf("%d", &sel) != 1) sel = 2;
+                freeLandmarks(city.alt);
+                city.alt = buildLandmarks(&city, k, sel == 1 ? LANDMARKS_FARTHEST : LANDMARKS_AVOID);
+                printf("%d landmarks ready\n", city.alt->count);
+                routeAlgo = ALGO_ALT;
+            }
+            else printf("Invalid algorithm; keeping the current one.\n");
+        }
+
+        else if (choice == 7) {
+            int ns, nt;
+            printf("Number of sources and destinations: ");
+            if (scanf("%d %d", &ns, &nt) != 2 || ns < 1 || nt < 1) {
+                printf("Invalid counts\n");
+                continue;
+            }
+            int *src = malloc(ns * sizeof(int)), *dst = malloc(nt * sizeof(int));
+            printf("Source indices: ");
+            for (int i = 0; i < ns; i++) scanf("%d", &src[i]);
+            printf("Destination indices: ");
+            for (int j = 0; j < nt; j++) scanf("%d", &dst[j]);
+            int dep;
+            printf("Enter departure time (0 = start of the light cycles): ");
+            if (scanf("%d", &dep) != 1) dep = 0;
+            int *m = travelTimeMatrix(&city, src, ns, dst, nt, dep, 0);
+            if (!m) {
+                printf("Invalid source/destination indices or departure time.\n");
+            } else {
+                printf("\n%-20s", "");
+                for (int j = 0; j < nt; j++) printf(" %10.10s", city.names[dst[j]]);
+                printf("\n");
+                for (int i = 0; i < ns; i++) {
+                    printf("%-20s", city.names[src[i]]);
+                    for (int j = 0; j < nt; j++) {
+                        int t = m[(size_t)i * nt + j];
+                        if (t == INF) printf(" %10s", "-");
+                        else printf(" %10d", t);
+                    }
+                    printf("\n");
+                }
+                free(m);
+            }
+            free(src);
+            free(dst);
+        }
+
+        else if (choice == 8) {
+            int s, d, from, to;
+            printf("Enter source and destination index: ");
+            scanf("%d %d", &s, &d);
+            printf("Enter first and last departure time: ");
+            if (scanf("%d %d", &from, &to) != 2) from = to = -1;
+            static QueryContext *pqc = NULL;
+            if (!pqc) pqc = createQueryContext(city.vertices);
+            ArrivalProfile *p = profileQuery(&city, pqc, s, d, from, to);
+            if (!p) {
+                printf("Invalid indices or window (at most %d departures).\n", PROFILE_MAX_WINDOW);
+                continue;
+            }
+            if (p->arrival[0] == INF) {
+                printf("\nNo path found from %s to %s\n", city.names[s], city.names[d]);
+            } else {
+                printf("\n%-24s %s\n", "Departure", "Arrival");
+                for (int k = 0; k < p->n; k++) {
+                    int last = k + 1 < p->n ? p->depart[k+1] - 1 : p->to;
+                    char dep[32];
+                    snprintf(dep, sizeof(dep), "%d - %d", p->depart[k], last);
+                    if (p->slope[k] == 0 || last == p->depart[k])
+                        printf("%-24s %d\n", dep, p->arrival[k]);
+                    else
+                        printf("%-24s %d - %d\n", dep, p->arrival[k],
+                               p->arrival[k] + p->slope[k] * (last - p->depart[k]));
+                }
+            }
+            freeArrivalProfile(p);
+        }
+
+        else if (choice == 9) {
+            int s, d, deadline;
+            printf("Enter source and destination index: ");
+            scanf("%d %d", &s, &d);
+            printf("Enter arrival deadline: ");
+            if (scanf("%d", &deadline) != 1) deadline = -1;
+            static QueryContext *lqc = NULL;
+            if (!lqc) lqc = createQueryContext(city.vertices);
+            int *path = malloc((city.vertices ? city.vertices : 1) * sizeof(int));
+            RouteResult res;
+            if (!latestDeparture(&city, lqc, s, d, deadline, path, &res)) {
+                printf("Invalid source/destination indices or deadline.\n");
+            } else if (res.cost == INF) {
+                printf("\nNo departure from %s reaches %s by %d\n",
+                       city.names[s], city.names[d], deadline);
+            } else {
+                printf("\nLatest departure from %s = %d (arriving at %s at %d)\n",
+                       city.names[s], res.depart, city.names[d], res.arrival);
+                for (int i = 0; i < res.path_len; i++)
+                    printf("%s%s", city.names[path[i]], i + 1 < res.path_len ? " -> " : "\n");
+            }
+            free(path);
+        }
+
         else {
             if (choice != 0)
                 printf("Invalid choice. Try again.\n");